@@ -26,9 +26,19 @@
 #define _QORE_QC_SAXITERATOR_H
 
 #include "QC_XmlReader.h"
+#include "QoreXPath.h"
+#include "ql_xml.h"
 #include "qore/InputStream.h"
 
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+
+#ifdef LIBXML_PATTERN_ENABLED
+#include <libxml/pattern.h>
+#endif
 
 DLLEXPORT extern qore_classid_t CID_SAXITERATOR;
 DLLLOCAL QoreClass *initSaxIteratorClass(QoreNamespace& ns);
@@ -41,29 +51,276 @@ DLLLOCAL QoreClass *initInputStreamSaxIteratorClass(QoreNamespace& ns);
 
 DLLLOCAL extern QoreClass* QC_SAXITERATOR;
 
+// a field projection and a record filter evaluated while streaming through each record
+class QoreSaxProjection {
+public:
+   DLLLOCAL QoreSaxProjection() : child_preds(false) {
+   }
+
+   // sets the projection from the "fields" and "filter" keys of the option hash
+   // returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int set(const QoreHashNode* opts, const char* err, ExceptionSink* xsink);
+
+   DLLLOCAL bool empty() const {
+      return fields.empty() && preds.empty();
+   }
+
+   // adds a predicate requiring the given value at the given path; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int addFilter(const std::string& path, const std::string& val, const char* opt, const char* err, ExceptionSink* xsink);
+
+   // processes the record element that the reader is positioned on
+   // returns 1 = the record matches, 0 = the record does not match, -1 = error (exception raised)
+   // if a value is returned in "val", then "has_val" is set and the reader is left on the last node of the record;
+   // "pending" is set if the reader has been moved to the node after the record
+   DLLLOCAL int process(QoreXmlReader& r, AbstractQoreNode*& val, bool& has_val, bool& pending, ExceptionSink* xsink) const;
+
+private:
+   // a path that is either projected, tested by a predicate or both
+   struct target {
+      bool field;
+      int pred;
+
+      DLLLOCAL target() : field(false), pred(-1) {
+      }
+   };
+
+   typedef std::map<std::string, target> tmap_t;
+   typedef std::vector<std::pair<std::string, std::string> > strpair_vec_t;
+   typedef std::vector<std::string> strvec_t;
+   typedef std::map<std::string, strvec_t> attrmap_t;
+
+   // projected paths in order
+   strvec_t fields;
+   // predicate paths and required values
+   strpair_vec_t preds;
+   // all paths by full path
+   tmap_t targets;
+   // attribute names by element path; the record element's path is empty
+   attrmap_t attrs;
+   // element paths that must be descended into
+   std::set<std::string> prefixes;
+   // true if there are predicates for anything but attributes of the record element
+   bool child_preds;
+
+   DLLLOCAL target& addPath(const std::string& path);
+
+   // processes a value for the given path
+   DLLLOCAL void store(const std::string& path, QoreStringNode* str, QoreHashNode* h, std::vector<bool>& matched) const;
+
+   // returns true if all predicates match the given decoded record
+   DLLLOCAL bool matchValue(const AbstractQoreNode* n) const;
+};
+
+#ifdef LIBXML_PATTERN_ENABLED
+// a compiled streaming pattern; patterns are not modified when matched, so they are shared between iterator copies
+class QoreSaxPattern {
+public:
+   DLLLOCAL QoreSaxPattern(xmlPatternPtr p) : pattern(p) {
+   }
+
+   DLLLOCAL ~QoreSaxPattern() {
+      xmlFreePattern(pattern);
+   }
+
+   DLLLOCAL xmlStreamCtxtPtr getStreamCtxt() const {
+      return xmlPatternGetStreamCtxt(pattern);
+   }
+
+private:
+   xmlPatternPtr pattern;
+};
+#endif
+
+// matches elements against the forward-only XPath subset supported by libxml2's pattern module while the reader
+// moves forward; only the path from the root to the current element is kept, so memory use does not depend on the
+// size of the document
+class QoreSaxStreamMatcher {
+public:
+   // compiles the expression; returns 0 if there is an error (exception raised)
+   DLLLOCAL static QoreSaxStreamMatcher* create(const char* expr, const xpath_ns_vec_t& nsv, const char* err, ExceptionSink* xsink);
+
+   DLLLOCAL QoreSaxStreamMatcher(const QoreSaxStreamMatcher& old);
+
+   DLLLOCAL ~QoreSaxStreamMatcher();
+
+   // returns 1 if the element that the reader is positioned on matches, 0 if not, -1 = error (exception raised)
+   DLLLOCAL int match(QoreXmlReader& r, ExceptionSink* xsink);
+
+   // resets the matcher to the beginning of the document
+   DLLLOCAL void reset();
+
+private:
+#ifdef LIBXML_PATTERN_ENABLED
+   std::shared_ptr<QoreSaxPattern> pattern;
+   xmlStreamCtxtPtr stream;
+#endif
+   // the number of elements pushed on the stream context
+   int stream_depth;
+
+#ifdef LIBXML_PATTERN_ENABLED
+   DLLLOCAL QoreSaxStreamMatcher(const std::shared_ptr<QoreSaxPattern>& p) : pattern(p), stream(0), stream_depth(0) {
+   }
+#endif
+
+   DLLLOCAL QoreSaxStreamMatcher& operator=(const QoreSaxStreamMatcher&);
+};
+
 class QoreSaxIterator : public QoreXmlReaderData, public QoreAbstractIteratorBase {
 protected:
    std::string element_name;
    int element_depth;
    bool val;
+   // set when the current element has been decoded in place by nextBatch()
+   bool consumed;
+   // set when the reader has been moved to a node that has not been examined yet
+   bool pending;
+   // the current value when decoded while streaming
+   AbstractQoreNode* cval;
+   bool has_cval;
+   // optional projection and filter
+   QoreSaxProjection* proj;
+   // optional streaming XPath matcher used instead of the element name
+   QoreSaxStreamMatcher* matcher;
+   // optional compiled schemas for validation, shared with copies
+#ifdef HAVE_XMLTEXTREADERSETSCHEMA
+   std::shared_ptr<QoreXmlSchemaContext> xsd;
+#endif
+#ifdef HAVE_XMLTEXTREADERRELAXNGSETSCHEMA
+   std::shared_ptr<QoreXmlRelaxNGContext> rng;
+#endif
+
+   // the number of elements found
+   int64 record_count;
+
+   // sets any schema on the reader; must be called before the first read
+   DLLLOCAL int applyValidation(ExceptionSink* xsink) {
+#ifdef HAVE_XMLTEXTREADERSETSCHEMA
+      if (xsd && setSchema(xsd->getSchema()) < 0) {
+         if (!*xsink)
+            xsink->raiseException("XSD-VALIDATION-ERROR", "the XSD schema could not be set for validation");
+         return -1;
+      }
+#endif
+#ifdef HAVE_XMLTEXTREADERRELAXNGSETSCHEMA
+      if (rng && setRelaxNG(rng->getSchema()) < 0) {
+         if (!*xsink)
+            xsink->raiseException("RELAXNG-VALIDATION-ERROR", "the RelaxNG schema could not be set for validation");
+         return -1;
+      }
+#endif
+      return 0;
+   }
+
+   // sets the "xsd" and "relaxng" options; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setValidation(const QoreHashNode* opts, const char* err, ExceptionSink* xsink);
+
+   // sets the "xpath" and "xpath_ns" options; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setXPath(const QoreHashNode* opts, const char* err, ExceptionSink* xsink);
+
+   // returns 1 if the element that the reader is positioned on is a record element, 0 if not, -1 = error (exception raised)
+   DLLLOCAL int matchElement(ExceptionSink* xsink) {
+      if (matcher)
+         return matcher->match(*this, xsink);
+      if (element_depth >= 0 && element_depth != depth())
+         return 0;
+      const char* n = localName();
+      if (!n || element_name != n)
+         return 0;
+      if (element_depth == -1)
+         element_depth = depth();
+      return 1;
+   }
+
+   DLLLOCAL void clearValue() {
+      if (has_cval) {
+         if (cval)
+            cval->deref(0);
+         cval = 0;
+         has_cval = false;
+      }
+   }
 
 public:
-   DLLLOCAL QoreSaxIterator(InputStream *is, const char* ename, const char* enc, ExceptionSink* xsink) : QoreXmlReaderData(is, enc, xsink), element_name(ename), element_depth(-1), val(true) {
+   DLLLOCAL QoreSaxIterator(InputStream *is, const char* ename, const char* enc, ExceptionSink* xsink, const QoreXmlReadAheadOptions* rao = 0) : QoreXmlReaderData(is, enc, xsink, rao), element_name(ename), element_depth(-1), val(true), consumed(false), pending(false), cval(0), has_cval(false), proj(0), matcher(0), record_count(0) {
    }
 
-   DLLLOCAL QoreSaxIterator(QoreStringNode* xml, const char* ename, ExceptionSink* xsink) : QoreXmlReaderData(xml, xsink), element_name(ename), element_depth(-1), val(false) {
+   DLLLOCAL QoreSaxIterator(QoreStringNode* xml, const char* ename, ExceptionSink* xsink) : QoreXmlReaderData(xml, xsink), element_name(ename), element_depth(-1), val(false), consumed(false), pending(false), cval(0), has_cval(false), proj(0), matcher(0), record_count(0) {
    }
 
-   DLLLOCAL QoreSaxIterator(QoreXmlDocData* doc, const char* ename, ExceptionSink* xsink) : QoreXmlReaderData(doc, xsink), element_name(ename), element_depth(-1), val(false) {
+   DLLLOCAL QoreSaxIterator(QoreXmlDocData* doc, const char* ename, ExceptionSink* xsink) : QoreXmlReaderData(doc, xsink), element_name(ename), element_depth(-1), val(false), consumed(false), pending(false), cval(0), has_cval(false), proj(0), matcher(0), record_count(0) {
    }
 
-   DLLLOCAL QoreSaxIterator(ExceptionSink* xsink, const char* fn, const char* ename, const char* enc = 0) : QoreXmlReaderData(fn, enc, xsink), element_name(ename), element_depth(-1), val(false) {
+   DLLLOCAL QoreSaxIterator(ExceptionSink* xsink, const char* fn, const char* ename, const char* enc = 0, const QoreXmlRecordRange* range = 0) : QoreXmlReaderData(fn, enc, xsink, range), element_name(ename), element_depth(-1), val(false), consumed(false), pending(false), cval(0), has_cval(false), proj(0), matcher(0), record_count(0) {
    }
 
-   DLLLOCAL QoreSaxIterator(const QoreSaxIterator& old, ExceptionSink* xsink) : QoreXmlReaderData(old, xsink), element_name(old.element_name), element_depth(-1), val(false) {
+   DLLLOCAL QoreSaxIterator(const QoreSaxIterator& old, ExceptionSink* xsink) : QoreXmlReaderData(old, xsink), element_name(old.element_name), element_depth(-1), val(false), consumed(false), pending(false), cval(0), has_cval(false), proj(old.proj ? new QoreSaxProjection(*old.proj) : 0),
+        matcher(old.matcher ? new QoreSaxStreamMatcher(*old.matcher) : 0)
+#ifdef HAVE_XMLTEXTREADERSETSCHEMA
+      , xsd(old.xsd)
+#endif
+#ifdef HAVE_XMLTEXTREADERRELAXNGSETSCHEMA
+      , rng(old.rng)
+#endif
+      , record_count(0)
+   {
+      if (!*xsink)
+         applyValidation(xsink);
+   }
+
+   DLLLOCAL ~QoreSaxIterator() {
+      clearValue();
+      delete proj;
+      delete matcher;
+   }
+
+   DLLLOCAL virtual int64 getErrorRecord() {
+      // the reader may already be positioned on the start tag of the next element, which has not been counted yet
+      if (!matcher && nodeType() == XML_READER_TYPE_ELEMENT && (element_depth < 0 || element_depth == depth())) {
+         const char* n = localName();
+         if (n && element_name == n)
+            return record_count + 1;
+      }
+      return record_count;
+   }
+
+   // sets all iterator options; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setOptions(const QoreHashNode* opts, const char* err, ExceptionSink* xsink) {
+      return setProjection(opts, err, xsink) || setXPath(opts, err, xsink) || setValidation(opts, err, xsink) ? -1 : 0;
+   }
+
+   // resets the reader to the beginning of the input
+   DLLLOCAL void reset(ExceptionSink* xsink) {
+      pending = false;
+      clearValue();
+      if (matcher)
+         matcher->reset();
+      QoreXmlReaderData::reset(xsink);
+      record_count = 0;
+      if (!*xsink)
+         applyValidation(xsink);
+   }
+
+   // sets the "fields" and "filter" options; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setProjection(const QoreHashNode* opts, const char* err, ExceptionSink* xsink) {
+      if (!opts)
+         return 0;
+      std::unique_ptr<QoreSaxProjection> p(new QoreSaxProjection);
+      if (p->set(opts, err, xsink))
+         return -1;
+      if (!p->empty()) {
+         delete proj;
+         proj = p.release();
+      }
+      return 0;
    }
 
    DLLLOCAL AbstractQoreNode* getReferencedValue(ExceptionSink* xsink) {
+      if (has_cval && !consumed)
+         return cval ? cval->refSelf() : 0;
+      if (consumed) {
+         xsink->raiseException("INVALID-ITERATOR", "the current element has already been returned by SaxIterator::nextBatch(); call SaxIterator::next() to move to the next element");
+         return 0;
+      }
       SimpleRefHolder<QoreStringNode> holder(getOuterXml());
       if (!holder)
          return 0;
@@ -77,28 +334,52 @@ public:
          return 0;
 
       ReferenceHolder<QoreHashNode> h(reader.parseXmlData(QCS_UTF8, XPF_NONE, xsink), xsink);
-      AbstractQoreNode* n = h->getKeyValue(element_name.c_str());
+      if (!h)
+         return 0;
+      // elements matched with an XPath expression may have any name
+      AbstractQoreNode* n = matcher ? (h->getFirstKey() ? h->getKeyValue(h->getFirstKey()) : 0) : h->getKeyValue(element_name.c_str());
       return n ? n->refSelf() : 0;
    }
 
    DLLLOCAL bool next(ExceptionSink* xsink) {
+      consumed = false;
+      clearValue();
       if (!val) {
          if (!isValid())
             reset(xsink);
       }
 
       while (true) {
-         if (readSkipWhitespace(xsink) != 1) {
+         if (pending) {
+            // the reader has already been moved to the next node by skipping a record
+            pending = false;
+            if (nodeType() == XML_READER_TYPE_SIGNIFICANT_WHITESPACE && readSkipWhitespace(xsink) != 1) {
+               val = false;
+               break;
+            }
+         }
+         else if (readSkipWhitespace(xsink) != 1 || *xsink) {
             val = false;
             break;
          }
          if (nodeType() == XML_READER_TYPE_ELEMENT) {
-            if (element_depth >= 0 && element_depth != depth())
-               continue;
-            const char* n = localName();
-            if (n && element_name == n) {
-               if (element_depth == -1)
-                  element_depth = depth();
+            int mrc = matchElement(xsink);
+            if (mrc < 0) {
+               val = false;
+               break;
+            }
+            if (mrc) {
+               ++record_count;
+
+               if (proj) {
+                  int rc = proj->process(*this, cval, has_cval, pending, xsink);
+                  if (rc < 0) {
+                     val = false;
+                     break;
+                  }
+                  if (!rc)
+                     continue;
+               }
 
                if (!val)
                   val = true;
@@ -110,6 +391,29 @@ public:
       return val;
    }
 
+   // returns a list of up to n element values; the elements are decoded in place without re-parsing
+   DLLLOCAL QoreListNode* nextBatch(int64 n, ExceptionSink* xsink) {
+      ReferenceHolder<QoreListNode> l(new QoreListNode, xsink);
+      while (n-- > 0) {
+         if (!next(xsink))
+            break;
+         AbstractQoreNode* v;
+         if (has_cval) {
+            v = cval;
+            cval = 0;
+            has_cval = false;
+         }
+         else {
+            v = getElementData(QCS_UTF8, XPF_NONE, xsink);
+            if (*xsink)
+               return 0;
+         }
+         consumed = true;
+         l->push(v);
+      }
+      return *xsink ? 0 : l.release();
+   }
+
    DLLLOCAL bool valid() const {
       return val;
    }
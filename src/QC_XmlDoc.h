@@ -27,6 +27,11 @@
 
 #include "QoreXmlDoc.h"
 
+#include "qore/QoreThreadLock.h"
+
+#include <set>
+#include <map>
+
 DLLEXPORT extern qore_classid_t CID_XMLDOC;
 DLLLOCAL QoreClass *initXmlDocClass(QoreNamespace& ns);
 
@@ -35,14 +40,72 @@ DLLLOCAL extern QoreClass* QC_XMLDOC;
 class QoreXmlNodeData;
 
 class QoreXmlDocData : public AbstractPrivateData, public QoreXmlDoc {
+private:
+   typedef std::set<xmlNodePtr> node_set_t;
+   typedef std::map<xmlNodePtr, int> node_ref_map_t;
+   // the roots of subtrees unlinked from the tree that are still referenced by XmlNode objects
+   node_set_t orphans;
+   // the number of XmlNode objects (and iterator positions) referencing each node of the document
+   node_ref_map_t node_refs;
+   // protects orphans and node_refs; XmlNode objects of frozen documents can be created and destroyed in any thread
+   QoreThreadLock m;
+   // set when the document has been made read-only so it can be shared between threads
+   bool frozen;
+
+   // returns true if the given node or any node in its subtree is referenced; must be called with the lock held
+   DLLLOCAL bool isReferenced(xmlNodePtr n) const;
+
+   // frees the unlinked subtree containing the given node if nothing in it is referenced anymore; must be called with the lock held
+   DLLLOCAL void releaseOrphan(xmlNodePtr n);
+
 public:
-   DLLLOCAL QoreXmlDocData(const char *buf, int size) : QoreXmlDoc(buf, size) {
+   DLLLOCAL QoreXmlDocData(const char *buf, int size) : QoreXmlDoc(buf, size), frozen(false) {
    }
-   DLLLOCAL QoreXmlDocData(const QoreString &xml) : QoreXmlDoc(xml) {
+   DLLLOCAL QoreXmlDocData(const QoreString &xml) : QoreXmlDoc(xml), frozen(false) {
    }
-   DLLLOCAL QoreXmlDocData(const QoreXmlDocData &orig) : QoreXmlDoc(orig) {
+   DLLLOCAL QoreXmlDocData(xmlDocPtr p) : QoreXmlDoc(p), frozen(false) {
    }
+   DLLLOCAL QoreXmlDocData(const QoreXmlDocData &orig) : QoreXmlDoc(orig), frozen(false) {
+   }
+   DLLLOCAL ~QoreXmlDocData() {
+      // orphans must be freed before the document and its dictionary
+      for (node_set_t::iterator i = orphans.begin(), e = orphans.end(); i != e; ++i)
+         xmlFreeNode(*i);
+   }
+   // unlinks the node from the tree; it is freed immediately if no XmlNode object refers to it or to any of its
+   // descendants, otherwise it's kept until the last such reference is released
+   DLLLOCAL void orphan(xmlNodePtr n);
+
+   // unlinks the node so it can be linked into the tree again; if the node was part of an unlinked subtree, the
+   // rest of the subtree is freed if it's no longer referenced
+   DLLLOCAL void adopt(xmlNodePtr n);
+
+   // registers a reference to the given node
+   DLLLOCAL void refNode(xmlNodePtr n) {
+      AutoLocker al(m);
+      ++node_refs[n];
+   }
+
+   // releases a reference to the given node; frees the unlinked subtree containing it if it's no longer referenced
+   DLLLOCAL void derefNode(xmlNodePtr n);
+
    DLLLOCAL QoreXmlNodeData *getRootElement();
+
+   // makes the document read-only; must not be called while the document is being accessed in another thread
+   DLLLOCAL void freeze();
+
+   DLLLOCAL bool isFrozen() const {
+      return frozen;
+   }
+
+   // returns 0 if the document can be modified, otherwise raises an exception and returns -1
+   DLLLOCAL int checkFrozen(const char* meth, ExceptionSink* xsink) const {
+      if (frozen) {
+         xsink->raiseException("XMLDOC-FROZEN-ERROR", "%s(): the document is frozen and cannot be modified", meth);
+         return -1;
+      }
+      return 0;
+   }
 };
 
 #endif
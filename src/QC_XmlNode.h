@@ -31,6 +31,9 @@ DLLEXPORT extern qore_classid_t CID_XMLNODE;
 DLLEXPORT extern QoreClass *QC_XMLNODE;
 DLLLOCAL QoreClass *initXmlNodeClass(QoreNamespace& ns);
 
+// returns true if the node is an element with the given local or qualified name
+DLLLOCAL bool xml_element_name_match(xmlNodePtr n, const char* name);
+
 class QoreXmlNodeData : public AbstractPrivateData {
 private:
    xmlNodePtr ptr;
@@ -39,8 +42,11 @@ private:
 
 public:
    DLLLOCAL QoreXmlNodeData(xmlNodePtr n_ptr, QoreXmlDocData *n_doc = 0, bool d = false) : ptr(n_ptr), doc(n_doc), del(d) {
-      if (doc)
+      if (doc) {
 	 doc->ref();
+	 if (ptr)
+	    doc->refNode(ptr);
+      }
    }
    DLLLOCAL QoreXmlNodeData(const QoreXmlNodeData &orig) {
       ptr = xmlCopyNode(orig.ptr, 1);
@@ -51,8 +57,10 @@ public:
       if (ptr) {
 	 if (del)
 	    xmlFreeNode(ptr);
-	 if (doc)
+	 if (doc) {
+	    doc->derefNode(ptr);
 	    doc->deref();
+	 }
       }
    }
    DLLLOCAL operator bool() const {
@@ -242,6 +250,35 @@ public:
    DLLLOCAL int64 getElementType() const {
       return ptr->type;
    }
+   DLLLOCAL xmlNodePtr getPtr() const {
+      return ptr;
+   }
+   DLLLOCAL QoreXmlDocData* getDoc() const {
+      return doc;
+   }
+
+   // links the given node as the last child (where = 0), previous sibling (where < 0) or next sibling (where > 0)
+   // of this node; nodes from the same document are moved, nodes from other documents are copied
+   // returns the linked node or 0 if an exception was raised
+   DLLLOCAL QoreXmlNodeData* link(QoreXmlNodeData* n, int where, const char* meth, ExceptionSink* xsink);
+   // adds a new element with optional text content as the last child; returns 0 if an exception was raised
+   DLLLOCAL QoreXmlNodeData* addNewChild(const char* name, const char* content, ExceptionSink* xsink);
+   // returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setProp(const char* name, const char* value, ExceptionSink* xsink);
+   // returns 1 = removed, 0 = not found, -1 = error (exception raised)
+   DLLLOCAL int removeProp(const char* name, ExceptionSink* xsink);
+   // returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setContent(const char* content, ExceptionSink* xsink);
+   // unlinks the node from the tree; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int remove(ExceptionSink* xsink);
+
+private:
+   // returns 0 if the node can be modified, otherwise raises an exception and returns -1
+   DLLLOCAL int checkModify(const char* meth, ExceptionSink* xsink) const;
+   // finds the namespace for a qualified name; returns -1 if the prefix is not declared (exception raised)
+   DLLLOCAL int getNs(const char* name, xmlNsPtr& ns, const char*& local, const char* meth, ExceptionSink* xsink) const;
+   // replaces the children of the node with the given text without freeing nodes that may be referenced
+   DLLLOCAL void replaceChildren(const char* content);
    DLLLOCAL QoreStringNode *getXML() {
       if (!doc)
 	 return 0;
@@ -0,0 +1,109 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+  QC_XmlNodeIterator.h
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _QORE_QC_XMLNODEITERATOR_H
+
+#define _QORE_QC_XMLNODEITERATOR_H
+
+#include "QC_XmlNode.h"
+
+#include <string>
+
+DLLEXPORT extern qore_classid_t CID_XMLNODEITERATOR;
+DLLEXPORT extern QoreClass* QC_XMLNODEITERATOR;
+DLLLOCAL QoreClass* initXmlNodeIteratorClass(QoreNamespace& ns);
+
+// a cursor over the children or descendants of a node; moving the cursor does not create any objects
+class QoreXmlNodeIterator : public AbstractPrivateData, public QoreAbstractIteratorBase {
+public:
+   DLLLOCAL QoreXmlNodeIterator(QoreXmlNodeData* n_node) : node(n_node), cur(0), depth(0), descendants(false), elements_only(false), started(false) {
+      node->ref();
+   }
+
+   DLLLOCAL QoreXmlNodeIterator(const QoreXmlNodeIterator& old) : node(old.node), cur(0), depth(0), descendants(old.descendants), elements_only(old.elements_only), name(old.name), started(false) {
+      node->ref();
+   }
+
+   // sets the "descendants", "elements_only" and "name" options; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int setOptions(const QoreHashNode* opts, ExceptionSink* xsink);
+
+   // moves to the next matching node; returns false if there are no more nodes
+   DLLLOCAL bool next();
+
+   DLLLOCAL bool valid() const {
+      return cur;
+   }
+
+   DLLLOCAL void reset() {
+      setCurrent(0);
+      depth = 0;
+      started = false;
+   }
+
+   // returns the current node or 0 with an exception raised if the iterator is not valid
+   DLLLOCAL xmlNodePtr get(ExceptionSink* xsink) const {
+      if (!cur)
+         xsink->raiseException("INVALID-ITERATOR", "the XmlNodeIterator is not pointing at a valid node");
+      return cur;
+   }
+
+   // returns the depth of the current node relative to the iterator's node; children have depth 1
+   DLLLOCAL int getDepth() const {
+      return depth;
+   }
+
+   // returns a new node object for the current node
+   DLLLOCAL QoreXmlNodeData* getNode() const {
+      return new QoreXmlNodeData(cur, node->getDoc());
+   }
+
+protected:
+   DLLLOCAL virtual ~QoreXmlNodeIterator() {
+      setCurrent(0);
+      node->deref();
+   }
+
+private:
+   // the node whose children or descendants are iterated; holds the reference to the document
+   QoreXmlNodeData* node;
+   // the current node
+   xmlNodePtr cur;
+   int depth;
+   bool descendants;
+   bool elements_only;
+   // optional element name filter
+   std::string name;
+   bool started;
+
+   // moves the cursor to the given node; the current node is referenced so that it's not freed if it's removed
+   // from the tree while the iterator is positioned on it
+   DLLLOCAL void setCurrent(xmlNodePtr n);
+
+   // returns the next node in document order without checking the filter
+   DLLLOCAL xmlNodePtr step(xmlNodePtr n);
+
+   // returns true if the node matches the filter
+   DLLLOCAL bool match(xmlNodePtr n) const;
+};
+
+#endif
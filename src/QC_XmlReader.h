@@ -38,12 +38,14 @@ private:
    QoreStringNode* xmlstr;
    std::string fn;
    std::string enc;
+   // the record range of the file to parse, if any
+   QoreXmlRecordRange range;
 
    // not implemented
    DLLLOCAL QoreXmlReaderData(const QoreXmlReaderData &orig);
 
 public:
-   DLLLOCAL QoreXmlReaderData(InputStream* is, const char* n_enc, ExceptionSink* xsink) : QoreXmlReader(xsink, is, n_enc, QORE_XML_PARSER_OPTIONS), doc(0), xmlstr(0), enc(n_enc ? n_enc : "") {
+   DLLLOCAL QoreXmlReaderData(InputStream* is, const char* n_enc, ExceptionSink* xsink, const QoreXmlReadAheadOptions* rao = 0) : QoreXmlReader(xsink, is, n_enc, QORE_XML_PARSER_OPTIONS, rao), doc(0), xmlstr(0), enc(n_enc ? n_enc : "") {
    }
 
    // n_xml must be in UTF8 encoding and must be referenced for the object
@@ -54,10 +56,12 @@ public:
       doc->ref();
    }
 
-   DLLLOCAL QoreXmlReaderData(const char* n_fn, const char* n_enc, ExceptionSink* xsink) : QoreXmlReader(xsink, n_fn, n_enc, QORE_XML_PARSER_OPTIONS), doc(0), xmlstr(0), fn(n_fn), enc(n_enc ? n_enc : "") {
+   DLLLOCAL QoreXmlReaderData(const char* n_fn, const char* n_enc, ExceptionSink* xsink, const QoreXmlRecordRange* n_range = 0) : QoreXmlReader(xsink, n_fn, n_enc, QORE_XML_PARSER_OPTIONS, n_range), doc(0), xmlstr(0), fn(n_fn), enc(n_enc ? n_enc : "") {
+      if (n_range)
+         range = *n_range;
    }
 
-   DLLLOCAL QoreXmlReaderData(const QoreXmlReaderData& old, ExceptionSink* xsink) : QoreXmlReader(xsink, old.xmlstr, QORE_XML_PARSER_OPTIONS, old.doc ? old.doc->getDocPtr() : 0, old.fn.empty() ? 0 : old.fn.c_str(), old.enc.empty() ? 0 : old.enc.c_str()), doc((QoreXmlDocData*)old.doc), xmlstr(old.xmlstr), fn(old.fn), enc(old.enc) {
+   DLLLOCAL QoreXmlReaderData(const QoreXmlReaderData& old, ExceptionSink* xsink) : QoreXmlReader(xsink, old.xmlstr, QORE_XML_PARSER_OPTIONS, old.doc ? old.doc->getDocPtr() : 0, old.fn.empty() ? 0 : old.fn.c_str(), old.enc.empty() ? 0 : old.enc.c_str(), old.range.isSet() ? &old.range : 0), doc((QoreXmlDocData*)old.doc), xmlstr(old.xmlstr), fn(old.fn), enc(old.enc), range(old.range) {
       if (doc) {
          assert(!xmlstr);
          doc->ref();
@@ -70,7 +74,7 @@ public:
 
    DLLLOCAL void reset(ExceptionSink* xsink) {
       if (!fn.empty())
-         QoreXmlReader::reset(xsink, fn.c_str(), enc.empty() ? 0 : enc.c_str(), QORE_XML_PARSER_OPTIONS);
+         QoreXmlReader::reset(xsink, fn.c_str(), enc.empty() ? 0 : enc.c_str(), QORE_XML_PARSER_OPTIONS, range.isSet() ? &range : 0);
       else if (xmlstr)
          QoreXmlReader::reset(xsink, xmlstr, QORE_XML_PARSER_OPTIONS, doc ? doc->getDocPtr() : 0);
       else
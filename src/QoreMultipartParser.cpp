@@ -0,0 +1,406 @@
+/* -*- indent-tabs-mode: nil -*- */
+/*
+  QoreMultipartParser.cpp
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "QoreMultipartParser.h"
+
+#include <string.h>
+#include <ctype.h>
+
+// buffers the data read from an input stream
+class QoreMultipartInput {
+public:
+   std::string buf;
+
+   DLLLOCAL QoreMultipartInput(InputStream* n_is) : is(n_is), eof(false) {
+   }
+
+   // reads the next block into the buffer; returns the number of bytes read, 0 = end of stream, -1 = error
+   DLLLOCAL int64 fill(ExceptionSink* xsink) {
+      if (eof)
+         return 0;
+      char chunk[QORE_MULTIPART_CHUNK_SIZE];
+      int64 rc = is->read(chunk, sizeof chunk, xsink);
+      if (*xsink)
+         return -1;
+      if (rc <= 0) {
+         eof = true;
+         return 0;
+      }
+      buf.append(chunk, rc);
+      return rc;
+   }
+
+   // returns the offset of the sequence in the buffer at or after the given offset, reading more data as
+   // necessary; returns -1 if the sequence is not found before the end of the stream or if an error occurred
+   DLLLOCAL int64 find(size_t off, const char* seq, size_t slen, ExceptionSink* xsink) {
+      while (true) {
+         const char* p = QoreMultipartParser::find(buf.data() + off, buf.data() + buf.size(), seq, slen);
+         if (p)
+            return p - buf.data();
+         // only the end of the buffer needs to be searched again
+         if (buf.size() >= slen)
+            off = buf.size() - slen + 1;
+         if (fill(xsink) <= 0)
+            return -1;
+      }
+   }
+
+   // ensures that the buffer contains at least the given number of bytes; returns false if not possible
+   DLLLOCAL bool need(size_t len, ExceptionSink* xsink) {
+      while (buf.size() < len) {
+         if (fill(xsink) <= 0)
+            return false;
+      }
+      return true;
+   }
+
+   // removes data from the start of the buffer
+   DLLLOCAL void consume(size_t len) {
+      buf.erase(0, len);
+   }
+
+private:
+   InputStream* is;
+   bool eof;
+};
+
+const char* QoreMultipartParser::find(const char* p, const char* e, const char* seq, size_t slen) {
+   while (p < e) {
+      p = (const char*)memchr(p, *seq, e - p);
+      if (!p || (size_t)(e - p) < slen)
+         return 0;
+      if (!memcmp(p, seq, slen))
+         return p;
+      ++p;
+   }
+   return 0;
+}
+
+QoreHashNode* QoreMultipartParser::parseHeaders(const char* p, const char* e) {
+   QoreHashNode* hdr = new QoreHashNode;
+   while (p < e) {
+      const char* le = find(p, e, "\r\n", 2);
+      if (!le)
+         le = e;
+      const char* c = (const char*)memchr(p, ':', le - p);
+      if (c) {
+         const char* ne = c;
+         while (p < ne && isspace(*p))
+            ++p;
+         while (ne > p && isspace(ne[-1]))
+            --ne;
+         std::string name(p, ne - p);
+         for (size_t i = 0; i < name.size(); ++i)
+            name[i] = tolower(name[i]);
+
+         const char* v = c + 1;
+         const char* ve = le;
+         while (v < ve && isspace(*v))
+            ++v;
+         while (ve > v && isspace(ve[-1]))
+            --ve;
+         hdr->setKeyValue(name.c_str(), new QoreStringNode(v, ve - v, QCS_DEFAULT), 0);
+      }
+      p = le + 2;
+   }
+   return hdr;
+}
+
+int QoreMultipartParser::getContentId(int i, const QoreHashNode* hdr, std::string& cid, ExceptionSink* xsink) {
+   const AbstractQoreNode* v = hdr->getKeyValue("content-id");
+   if (get_node_type(v) != NT_STRING) {
+      xsink->raiseException("SOAP-MESSAGE-ERROR", "expecting part header Content-ID in part %d", i);
+      return -1;
+   }
+   const QoreStringNode* str = reinterpret_cast<const QoreStringNode*>(v);
+   size_t len = str->strlen();
+   const char* buf = str->getBuffer();
+   if (len < 2 || buf[0] != '<' || buf[len - 1] != '>') {
+      xsink->raiseException("SOAP-MESSAGE-ERROR", "expected part ID to have the following format: <id>, instead got %s", buf);
+      return -1;
+   }
+   cid.assign(buf + 1, len - 2);
+   return 0;
+}
+
+// returns the given range with leading and trailing whitespace removed
+static std::string ct_trim(const std::string& str, size_t b, size_t e) {
+   while (b < e && isspace((unsigned char)str[b]))
+      ++b;
+   while (e > b && isspace((unsigned char)str[e - 1]))
+      --e;
+   return str.substr(b, e - b);
+}
+
+static void ct_lower(std::string& str) {
+   for (size_t i = 0; i < str.size(); ++i)
+      str[i] = tolower((unsigned char)str[i]);
+}
+
+QoreHashNode* QoreMultipartParser::parseContentType(const char* buf, size_t len, const QoreEncoding* enc) {
+   std::string ct(buf, len);
+   size_t pos = ct.find(';');
+   std::string type = ct_trim(ct, 0, pos == std::string::npos ? len : pos);
+   ct_lower(type);
+
+   QoreHashNode* rv = new QoreHashNode;
+   rv->setKeyValue("type", new QoreStringNode(type.c_str(), enc), 0);
+   QoreHashNode* params = new QoreHashNode;
+   rv->setKeyValue("params", params, 0);
+   while (pos != std::string::npos && ++pos < len) {
+      size_t eq = ct.find('=', pos);
+      if (eq == std::string::npos)
+         break;
+      // skip parameters without a value
+      size_t sc = ct.find(';', pos);
+      if (sc < eq) {
+         pos = sc;
+         continue;
+      }
+      std::string name = ct_trim(ct, pos, eq);
+      ct_lower(name);
+
+      pos = eq + 1;
+      while (pos < len && (ct[pos] == ' ' || ct[pos] == '\t'))
+         ++pos;
+
+      std::string val;
+      if (pos < len && ct[pos] == '"') {
+         // quoted values can contain ';'
+         size_t end = ct.find('"', pos + 1);
+         if (end == std::string::npos)
+            end = len;
+         val = ct.substr(pos + 1, end - pos - 1);
+         pos = end < len ? ct.find(';', end) : std::string::npos;
+      }
+      else {
+         pos = ct.find(';', pos);
+         val = ct_trim(ct, eq + 1, pos == std::string::npos ? len : pos);
+      }
+      if (!name.empty())
+         params->setKeyValue(name.c_str(), new QoreStringNode(val.c_str(), enc), 0);
+   }
+   return rv;
+}
+
+AbstractQoreNode* QoreMultipartParser::getBody(const QoreHashNode* hdr, const char* p, size_t len) const {
+   const AbstractQoreNode* v = hdr->getKeyValue("content-transfer-encoding");
+   if (get_node_type(v) == NT_STRING && !strcmp(reinterpret_cast<const QoreStringNode*>(v)->getBuffer(), "binary")) {
+      BinaryNode* b = new BinaryNode;
+      b->append(p, len);
+      return b;
+   }
+
+   // the data is tagged with the part's charset without conversion
+   const QoreEncoding* penc = enc;
+   v = hdr->getKeyValue("content-type");
+   if (get_node_type(v) == NT_STRING) {
+      const QoreStringNode* str = reinterpret_cast<const QoreStringNode*>(v);
+      ReferenceHolder<QoreHashNode> ct(parseContentType(str->getBuffer(), str->size(), QCS_DEFAULT), 0);
+      const AbstractQoreNode* cs = reinterpret_cast<const QoreHashNode*>(ct->getKeyValue("params"))->getKeyValue("charset");
+      if (cs && !reinterpret_cast<const QoreStringNode*>(cs)->empty())
+         penc = QEM.findCreate(reinterpret_cast<const QoreStringNode*>(cs)->getBuffer());
+   }
+   return new QoreStringNode(p, len, penc);
+}
+
+bool QoreMultipartParser::isRoot(int i, const QoreHashNode* hdr) const {
+   if (!has_start)
+      return i == 1;
+   const AbstractQoreNode* v = hdr->getKeyValue("content-id");
+   return get_node_type(v) == NT_STRING && start == reinterpret_cast<const QoreStringNode*>(v)->getBuffer();
+}
+
+void QoreMultipartParser::addPart(QoreHashNode* rv, QoreHashNode* part, bool root, const std::string& cid, ExceptionSink* xsink) {
+   if (root) {
+      rv->setKeyValue("body", part, xsink);
+      return;
+   }
+   QoreHashNode* ph = reinterpret_cast<QoreHashNode*>(rv->getKeyValue("part"));
+   if (!ph) {
+      ph = new QoreHashNode;
+      rv->setKeyValue("part", ph, xsink);
+   }
+   ph->setKeyValue(cid.c_str(), part, xsink);
+}
+
+int QoreMultipartParser::addPart(QoreHashNode* rv, int i, const char* p, const char* e, ExceptionSink* xsink) const {
+   // p points to the line break after the delimiter; headers are terminated by an empty line
+   const char* he = find(p, e, "\r\n\r\n", 4);
+   if (!he) {
+      xsink->raiseException("SOAP-MESSAGE-ERROR", "part %d has no headers", i);
+      return -1;
+   }
+
+   ReferenceHolder<QoreHashNode> hdr(parseHeaders(p + 2, he), xsink);
+   std::string cid;
+   if (getContentId(i, *hdr, cid, xsink))
+      return -1;
+
+   bool root = isRoot(i, *hdr);
+   QoreHashNode* part = new QoreHashNode;
+   part->setKeyValue("body", getBody(*hdr, he + 4, e - he - 4), xsink);
+   part->setKeyValue("hdr", hdr.release(), xsink);
+   addPart(rv, part, root, cid, xsink);
+   return 0;
+}
+
+QoreHashNode* QoreMultipartParser::parse(const char* buf, size_t len, ExceptionSink* xsink) {
+   const char* e = buf + len;
+   const char* p;
+   // the first delimiter does not need to be preceded by a line break
+   if (len >= delim.size() - 2 && !memcmp(buf, delim.data() + 2, delim.size() - 2))
+      p = buf + delim.size() - 2;
+   else {
+      p = find(buf, e, delim.data(), delim.size());
+      if (!p) {
+         xsink->raiseException("SOAP-MESSAGE-ERROR", "multipart message does not contain the boundary delimiter");
+         return 0;
+      }
+      p += delim.size();
+   }
+
+   ReferenceHolder<QoreHashNode> rv(new QoreHashNode, xsink);
+   for (int i = 1; ; ++i) {
+      // the close delimiter ends the message
+      if (e - p >= 2 && p[0] == '-' && p[1] == '-')
+         break;
+      // a part without a closing delimiter is ignored
+      const char* next = find(p, e, delim.data(), delim.size());
+      if (!next)
+         break;
+      if (addPart(*rv, i, p, next, xsink))
+         return 0;
+      p = next + delim.size();
+   }
+   return rv.release();
+}
+
+int QoreMultipartParser::getStream(const ResolvedCallReferenceNode* get_stream, const std::string& cid, const QoreHashNode* hdr, OutputStream*& os, ExceptionSink* xsink) {
+   ReferenceHolder<QoreListNode> args(new QoreListNode, xsink);
+   args->push(new QoreStringNode(cid.c_str()));
+   args->push(hdr->refSelf());
+   ValueHolder rv(get_stream->execValue(*args, xsink), xsink);
+   if (*xsink)
+      return -1;
+   if (rv->isNothing())
+      return 0;
+   if (rv->getType() == NT_OBJECT) {
+      os = static_cast<OutputStream*>(rv->get<QoreObject>()->getReferencedPrivateData(CID_OUTPUTSTREAM, xsink));
+      if (*xsink)
+         return -1;
+      if (os)
+         return 0;
+   }
+   xsink->raiseException("SOAP-MESSAGE-ERROR", "the stream callback for part <%s> must return an OutputStream object or NOTHING; got type '%s' instead", cid.c_str(), rv->getTypeName());
+   return -1;
+}
+
+QoreHashNode* QoreMultipartParser::parse(InputStream* is, const ResolvedCallReferenceNode* get_stream, ExceptionSink* xsink) {
+   QoreMultipartInput in(is);
+   // start with a line break so that the first delimiter is found at the start of the data as well
+   in.buf = "\r\n";
+   int64 off = in.find(0, delim.data(), delim.size(), xsink);
+   if (off < 0) {
+      if (!*xsink)
+         xsink->raiseException("SOAP-MESSAGE-ERROR", "multipart message does not contain the boundary delimiter");
+      return 0;
+   }
+   in.consume(off + delim.size());
+
+   ReferenceHolder<QoreHashNode> rv(new QoreHashNode, xsink);
+   for (int i = 1; ; ++i) {
+      if (!in.need(2, xsink)) {
+         if (*xsink)
+            return 0;
+         break;
+      }
+      // the close delimiter ends the message
+      if (in.buf[0] == '-' && in.buf[1] == '-')
+         break;
+
+      off = in.find(0, "\r\n\r\n", 4, xsink);
+      if (off < 0) {
+         if (!*xsink)
+            xsink->raiseException("SOAP-MESSAGE-ERROR", "part %d has no headers", i);
+         return 0;
+      }
+      ReferenceHolder<QoreHashNode> hdr(parseHeaders(in.buf.data() + 2, in.buf.data() + off), xsink);
+      in.consume(off + 4);
+
+      std::string cid;
+      if (getContentId(i, *hdr, cid, xsink))
+         return 0;
+      bool root = isRoot(i, *hdr);
+
+      OutputStream* os = 0;
+      if (!root && get_stream && getStream(get_stream, cid, *hdr, os, xsink))
+         return 0;
+      ReferenceHolder<OutputStream> osh(os, xsink);
+
+      QoreHashNode* part = new QoreHashNode;
+      if (os) {
+         // write the data to the stream as it is read, keeping back enough data to find the delimiter
+         int64 size = 0;
+         while (true) {
+            const char* d = find(in.buf.data(), in.buf.data() + in.buf.size(), delim.data(), delim.size());
+            size_t len = d ? d - in.buf.data() : (in.buf.size() < delim.size() ? 0 : in.buf.size() - delim.size() + 1);
+            if (len) {
+               os->write(in.buf.data(), len, xsink);
+               if (*xsink) {
+                  part->deref(xsink);
+                  return 0;
+               }
+               size += len;
+               in.consume(len);
+            }
+            if (d)
+               break;
+            if (in.fill(xsink) <= 0) {
+               part->deref(xsink);
+               if (!*xsink)
+                  xsink->raiseException("SOAP-MESSAGE-ERROR", "multipart message ended in part %d before the closing boundary delimiter", i);
+               return 0;
+            }
+         }
+         part->setKeyValue("size", new QoreBigIntNode(size), xsink);
+      }
+      else {
+         off = in.find(0, delim.data(), delim.size(), xsink);
+         if (off < 0) {
+            part->deref(xsink);
+            if (*xsink)
+               return 0;
+            // a part without a closing delimiter is ignored
+            break;
+         }
+         part->setKeyValue("body", getBody(*hdr, in.buf.data(), off), xsink);
+         in.consume(off);
+      }
+      in.consume(delim.size());
+
+      part->setKeyValue("hdr", hdr.release(), xsink);
+      addPart(*rv, part, root, cid, xsink);
+   }
+   return rv.release();
+}
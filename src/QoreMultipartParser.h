@@ -0,0 +1,93 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+  QoreMultipartParser.h
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _QORE_QOREMULTIPARTPARSER_H
+#define _QORE_QOREMULTIPARTPARSER_H
+
+#include "qore-xml-module.h"
+
+#include "qore/InputStream.h"
+#include "qore/OutputStream.h"
+
+#include <string>
+
+// the size of the blocks read from input streams
+#define QORE_MULTIPART_CHUNK_SIZE 16384
+
+// parses multipart/related message bodies as used by SOAP with attachments and MTOM; the data is scanned
+// once for the boundary delimiters and the data of each part is copied once into the value returned
+class QoreMultipartParser {
+public:
+   DLLLOCAL QoreMultipartParser(const char* boundary, const char* n_start, const QoreEncoding* n_enc)
+      : delim(std::string("\r\n--") + boundary), start(n_start ? n_start : ""), has_start(n_start), enc(n_enc) {
+   }
+
+   // parses a message in memory; returns a hash with "body" and "part" keys or 0 if an exception was raised
+   DLLLOCAL QoreHashNode* parse(const char* buf, size_t len, ExceptionSink* xsink);
+
+   // parses a message from a stream; the data of each part other than the root part is written to the
+   // output stream returned by the callback, if any, instead of being returned; returns 0 if an exception
+   // was raised
+   DLLLOCAL QoreHashNode* parse(InputStream* is, const ResolvedCallReferenceNode* get_stream, ExceptionSink* xsink);
+
+   // returns a pointer to the first occurrence of the sequence in the buffer or 0 if not found
+   DLLLOCAL static const char* find(const char* p, const char* e, const char* seq, size_t slen);
+
+   // parses a Content-Type header value; returns a hash with a "type" key giving the media type in lower case
+   // and a "params" key giving a hash of parameter names in lower case to the parameter values without any
+   // quotes; parameters without a value are ignored; string values are tagged with the given encoding
+   DLLLOCAL static QoreHashNode* parseContentType(const char* ct, size_t len, const QoreEncoding* enc);
+
+private:
+   // the delimiter including the leading line break
+   std::string delim;
+   // the Content-ID of the root part
+   std::string start;
+   bool has_start;
+   // the encoding of parts without a charset
+   const QoreEncoding* enc;
+
+   // parses the part headers between p and e; header names are converted to lower case
+   DLLLOCAL static QoreHashNode* parseHeaders(const char* p, const char* e);
+
+   // checks the part's Content-ID header and returns the ID without the angle brackets; returns -1 if an
+   // exception was raised
+   DLLLOCAL static int getContentId(int i, const QoreHashNode* hdr, std::string& cid, ExceptionSink* xsink);
+
+   // returns the body of the part as a binary value for binary parts or a string otherwise
+   DLLLOCAL AbstractQoreNode* getBody(const QoreHashNode* hdr, const char* p, size_t len) const;
+
+   // returns true if the part with the given headers is the root part
+   DLLLOCAL bool isRoot(int i, const QoreHashNode* hdr) const;
+
+   // adds a part to the result hash
+   DLLLOCAL static void addPart(QoreHashNode* rv, QoreHashNode* part, bool root, const std::string& cid, ExceptionSink* xsink);
+
+   // parses the part between p and e and adds it to the result hash; returns -1 if an exception was raised
+   DLLLOCAL int addPart(QoreHashNode* rv, int i, const char* p, const char* e, ExceptionSink* xsink) const;
+
+   // returns the output stream for the given part from the callback or 0; returns -1 if an exception was raised
+   DLLLOCAL static int getStream(const ResolvedCallReferenceNode* get_stream, const std::string& cid, const QoreHashNode* hdr, OutputStream*& os, ExceptionSink* xsink);
+};
+
+#endif
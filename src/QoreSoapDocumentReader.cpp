@@ -0,0 +1,487 @@
+/* -*- indent-tabs-mode: nil -*- */
+/*
+  QoreSoapDocumentReader.cpp
+
+  Qore Programming Language
+
+  Copyright (C) 2017 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "QoreSoapDocumentReader.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+static const QoreHashNode* sd_get_hash(const QoreHashNode* h, const char* key) {
+   const AbstractQoreNode* n = h ? h->getKeyValue(key) : 0;
+   return get_node_type(n) == NT_HASH ? reinterpret_cast<const QoreHashNode*>(n) : 0;
+}
+
+static int64 sd_get_int(const QoreHashNode* h, const char* key) {
+   const AbstractQoreNode* n = h->getKeyValue(key);
+   return n ? n->getAsBigInt() : 0;
+}
+
+static bool sd_get_bool(const QoreHashNode* h, const char* key) {
+   const AbstractQoreNode* n = h->getKeyValue(key);
+   return n ? n->getAsBool() : false;
+}
+
+// parses a decimal integer with an optional sign and at most 18 digits so that it cannot overflow; values in any
+// other form are left to the generic parser
+static int sd_parse_int(const char* p, int64& v) {
+   bool neg = false;
+   if (*p == '-' || *p == '+')
+      neg = (*p++ == '-');
+   if (!*p)
+      return -1;
+   v = 0;
+   for (int n = 0; *p; ++p, ++n) {
+      if (!isdigit(*p) || n == 18)
+         return -1;
+      v = v * 10 + (*p - '0');
+   }
+   if (neg)
+      v = -v;
+   return 0;
+}
+
+// returns true if the integer has no plus sign and no leading zeros, so that it is equal to its string value
+static bool sd_is_canonical_int(const char* p) {
+   if (*p == '+')
+      return false;
+   bool neg = (*p == '-');
+   if (neg)
+      ++p;
+   return *p != '0' || (!neg && !p[1]);
+}
+
+// parses an xsd:decimal value without an exponent
+static int sd_parse_decimal(const char* p, double& d) {
+   const char* s = p;
+   if (*p == '-' || *p == '+')
+      ++p;
+   bool digits = false;
+   while (isdigit(*p)) {
+      ++p;
+      digits = true;
+   }
+   if (*p == '.') {
+      ++p;
+      while (isdigit(*p)) {
+         ++p;
+         digits = true;
+      }
+   }
+   if (!digits || *p)
+      return -1;
+   d = strtod(s, 0);
+   return 0;
+}
+
+// creates a date from the first "max" characters of the value; only ASCII values are handled so that the
+// characters can be counted as bytes
+static int sd_parse_date(const char* p, size_t len, size_t max, AbstractQoreNode*& rv) {
+   for (size_t i = 0; i < len; ++i) {
+      if ((unsigned char)p[i] & 0x80)
+         return -1;
+   }
+   rv = new DateTimeNode(std::string(p, len > max ? max : len).c_str());
+   return 0;
+}
+
+QoreSoapDocumentReader::QoreSoapDocumentReader(QoreXmlReader& n_reader, const QoreHashNode* plan, const QoreEncoding* n_enc)
+   : reader(n_reader), parts(sd_get_hash(plan, "parts")), types(sd_get_hash(plan, "types")), enc(n_enc) {
+}
+
+int QoreSoapDocumentReader::nextNode() {
+   while (true) {
+      if (reader.read() != 1)
+         return -1;
+      int nt = reader.nodeType();
+      switch (nt) {
+         case XML_READER_TYPE_ELEMENT:
+         case XML_READER_TYPE_END_ELEMENT:
+         case XML_READER_TYPE_TEXT:
+         case XML_READER_TYPE_CDATA:
+            return nt;
+         // comments, processing instructions and whitespace are ignored as with parse_xml()
+         default:
+            break;
+      }
+   }
+}
+
+int QoreSoapDocumentReader::skipElement() {
+   if (reader.isEmptyElement())
+      return 0;
+   int d = reader.depth();
+   while (true) {
+      if (reader.read() != 1)
+         return -1;
+      if (reader.nodeType() == XML_READER_TYPE_END_ELEMENT && reader.depth() == d)
+         return 0;
+   }
+}
+
+const QoreHashNode* QoreSoapDocumentReader::getType(const QoreHashNode* ep) const {
+   const AbstractQoreNode* t = ep->getKeyValue("t");
+   if (get_node_type(t) == NT_STRING)
+      return sd_get_hash(types, reinterpret_cast<const QoreStringNode*>(t)->getBuffer());
+   return get_node_type(t) == NT_HASH ? reinterpret_cast<const QoreHashNode*>(t) : 0;
+}
+
+QoreHashNode* QoreSoapDocumentReader::parse(ExceptionSink* xsink) {
+   ReferenceHolder<QoreHashNode> rv(xsink);
+
+   if (parts && parts->size() && nextNode() == XML_READER_TYPE_ELEMENT && !strcmp(reader.localName(), "Envelope")
+       && !reader.isEmptyElement()) {
+      bool body = false;
+      while (true) {
+         int nt = nextNode();
+         if (nt == XML_READER_TYPE_END_ELEMENT)
+            break;
+         if (nt != XML_READER_TYPE_ELEMENT) {
+            rv = 0;
+            break;
+         }
+         const char* name = reader.localName();
+         // SOAP headers are only ignored; the plan is not used for messages with headers in the binding
+         if (!strcmp(name, "Header")) {
+            if (skipElement()) {
+               rv = 0;
+               break;
+            }
+            continue;
+         }
+         if (body || strcmp(name, "Body")) {
+            rv = 0;
+            break;
+         }
+         body = true;
+         rv = parseBody(xsink);
+         if (!rv)
+            break;
+      }
+
+      // make sure that the rest of the document is well-formed
+      if (rv) {
+         int rc;
+         while ((rc = reader.read()) == 1) {
+         }
+         if (rc)
+            rv = 0;
+      }
+   }
+
+   if (!rv && *xsink)
+      xsink->clear();
+   return rv.release();
+}
+
+QoreHashNode* QoreSoapDocumentReader::parseBody(ExceptionSink* xsink) {
+   // attributes of the Body element are ignored; an empty body has no parts
+   if (reader.isEmptyElement())
+      return 0;
+
+   // part element names to lists of values
+   ReferenceHolder<QoreHashNode> occ(new QoreHashNode, xsink);
+   while (true) {
+      int nt = nextNode();
+      if (nt == XML_READER_TYPE_END_ELEMENT)
+         break;
+      if (nt != XML_READER_TYPE_ELEMENT)
+         return 0;
+      // Fault, multiRef and any other elements are not covered by the plan
+      std::string name = reader.localName();
+      const QoreHashNode* ep = sd_get_hash(parts, name.c_str());
+      if (!ep)
+         return 0;
+      AbstractQoreNode* v;
+      bool bare;
+      if (parseElement(ep, v, bare, xsink))
+         return 0;
+      QoreListNode* l = reinterpret_cast<QoreListNode*>(occ->getKeyValue(name.c_str()));
+      if (!l) {
+         l = new QoreListNode;
+         occ->setKeyValue(name.c_str(), l, xsink);
+      }
+      l->push(v);
+   }
+
+   ReferenceHolder<QoreHashNode> rv(new QoreHashNode, xsink);
+   ConstHashIterator hi(parts);
+   while (hi.next()) {
+      const QoreHashNode* ep = reinterpret_cast<const QoreHashNode*>(hi.getValue());
+      const QoreListNode* l = reinterpret_cast<const QoreListNode*>(occ->getKeyValue(hi.getKey()));
+      // a single part is deserialized from the entire body if its element is missing
+      if (!l && parts->size() == 1)
+         return 0;
+      AbstractQoreNode* v;
+      if (getElementValue(ep, l, v))
+         return 0;
+      const AbstractQoreNode* part = ep->getKeyValue("part");
+      if (get_node_type(part) != NT_STRING) {
+         discard(v, xsink);
+         return 0;
+      }
+      rv->setKeyValue(reinterpret_cast<const QoreStringNode*>(part)->getBuffer(), v, xsink);
+   }
+
+   return rv.release();
+}
+
+int QoreSoapDocumentReader::parseElement(const QoreHashNode* ep, AbstractQoreNode*& rv, bool& bare, ExceptionSink* xsink) {
+   const QoreHashNode* tp = getType(ep);
+   if (!tp)
+      return -1;
+
+   // only namespace declarations are accepted; xsi:nil, xsi:type, href and any other attributes are left to the
+   // WSDL module
+   bool attrs = reader.hasAttributes();
+   if (attrs) {
+      int rc;
+      while ((rc = reader.moveToNextAttribute(xsink)) == 1) {
+         if (!reader.isNamespaceDecl())
+            return -1;
+      }
+      if (rc || reader.moveToElement(xsink) == -1)
+         return -1;
+   }
+
+   return tp->getKeyValue("el")
+      ? parseComplex(tp, attrs, rv, bare, xsink)
+      : parseSimple(tp, attrs, rv, bare, xsink);
+}
+
+int QoreSoapDocumentReader::parseSimple(const QoreHashNode* tp, bool attrs, AbstractQoreNode*& rv, bool& bare, ExceptionSink* xsink) {
+   const AbstractQoreNode* b = tp->getKeyValue("b");
+   if (get_node_type(b) != NT_STRING)
+      return -1;
+   const char* type = reinterpret_cast<const QoreStringNode*>(b)->getBuffer();
+
+   ReferenceHolder<AbstractQoreNode> val(xsink);
+   if (!reader.isEmptyElement()) {
+      while (true) {
+         int nt = nextNode();
+         if (nt == XML_READER_TYPE_END_ELEMENT)
+            break;
+         // child elements, CDATA and text split by comments are left to the generic parser
+         if (nt != XML_READER_TYPE_TEXT || val)
+            return -1;
+         AbstractQoreNode* v;
+         if (convertValue(type, reader.constValue(), v, xsink))
+            return -1;
+         val = v;
+      }
+   }
+
+   bare = !val && !attrs;
+   if (!val) {
+      if (attrs)
+         return -1;
+      // an empty element is only deserialized for types that accept an empty value
+      if (!strcmp(type, "string") || !strcmp(type, "anyURI"))
+         val = new QoreStringNode;
+      else if (!strcmp(type, "base64Binary") || !strcmp(type, "hexBinary"))
+         val = new BinaryNode;
+      else
+         return -1;
+   }
+
+   const QoreHashNode* eh = sd_get_hash(tp, "enum");
+   if (eh) {
+      if (val->getType() != NT_STRING)
+         return -1;
+      TempEncodingHelper key(reinterpret_cast<const QoreStringNode*>(*val), QCS_DEFAULT, xsink);
+      if (!key)
+         return -1;
+      const AbstractQoreNode* n = eh->getKeyValue(key->getBuffer());
+      if (!n || !n->getAsBool())
+         return -1;
+   }
+
+   rv = val.release();
+   return 0;
+}
+
+int QoreSoapDocumentReader::convertValue(const char* type, const char* str, AbstractQoreNode*& rv, ExceptionSink* xsink) {
+   if (!strcmp(type, "string") || !strcmp(type, "anyURI")) {
+      rv = reader.getValue(enc, xsink);
+      return rv ? 0 : -1;
+   }
+
+   if (!strcmp(type, "boolean")) {
+      if (!strcmp(str, "true") || !strcmp(str, "1"))
+         rv = get_bool_node(true);
+      else if (!strcmp(str, "false") || !strcmp(str, "0"))
+         rv = get_bool_node(false);
+      else
+         return -1;
+      return 0;
+   }
+
+   if (!strcmp(type, "decimal")) {
+      double d;
+      if (sd_parse_decimal(str, d))
+         return -1;
+      rv = new QoreFloatNode(d);
+      return 0;
+   }
+
+   if (!strcmp(type, "date"))
+      return sd_parse_date(str, strlen(str), 10, rv);
+
+   if (!strcmp(type, "dateTime"))
+      return sd_parse_date(str, strlen(str), 19, rv);
+
+   if (!strcmp(type, "base64Binary")) {
+      rv = parseBase64(str, strlen(str), xsink);
+      return rv ? 0 : -1;
+   }
+
+   if (!strcmp(type, "hexBinary")) {
+      rv = parseHex(str, strlen(str), xsink);
+      return rv ? 0 : -1;
+   }
+
+   // all other supported types are integer types
+   int64 v;
+   if (sd_parse_int(str, v))
+      return -1;
+
+   bool ok;
+   if (!strcmp(type, "integer"))
+      ok = sd_is_canonical_int(str);
+   else if (!strcmp(type, "long"))
+      ok = true;
+   else if (!strcmp(type, "byte") || !strcmp(type, "unsignedByte"))
+      ok = (v & 0xff) == v;
+   else if (!strcmp(type, "short"))
+      ok = v >= -32768 && v <= 32767;
+   else if (!strcmp(type, "int"))
+      ok = v >= -2147483648LL && v <= 2147483647LL;
+   else if (!strcmp(type, "unsignedShort"))
+      ok = (v & 0xffff) == v;
+   else if (!strcmp(type, "unsignedInt"))
+      ok = (v & 0xffffffffLL) == v;
+   else if (!strcmp(type, "unsignedLong") || !strcmp(type, "nonNegativeInteger"))
+      ok = v >= 0;
+   else if (!strcmp(type, "negativeInteger"))
+      ok = v < 0;
+   else if (!strcmp(type, "nonPositiveInteger"))
+      ok = v <= 0;
+   else if (!strcmp(type, "positiveInteger"))
+      ok = v > 0;
+   else
+      ok = false;
+
+   if (!ok)
+      return -1;
+   rv = new QoreBigIntNode(v);
+   return 0;
+}
+
+int QoreSoapDocumentReader::parseComplex(const QoreHashNode* tp, bool attrs, AbstractQoreNode*& rv, bool& bare, ExceptionSink* xsink) {
+   const QoreHashNode* el = sd_get_hash(tp, "el");
+   if (!el || !el->size())
+      return -1;
+
+   // element names to lists of values
+   ReferenceHolder<QoreHashNode> occ(new QoreHashNode, xsink);
+   // the number of child elements and if the first one was bare
+   int count = 0;
+   bool first_bare = false;
+   if (!reader.isEmptyElement()) {
+      while (true) {
+         int nt = nextNode();
+         if (nt == XML_READER_TYPE_END_ELEMENT)
+            break;
+         // text in a complex element is left to the generic parser
+         if (nt != XML_READER_TYPE_ELEMENT)
+            return -1;
+         std::string name = reader.localName();
+         const QoreHashNode* cep = sd_get_hash(el, name.c_str());
+         if (!cep)
+            return -1;
+         AbstractQoreNode* v;
+         bool cbare;
+         if (parseElement(cep, v, cbare, xsink))
+            return -1;
+         QoreListNode* l = reinterpret_cast<QoreListNode*>(occ->getKeyValue(name.c_str()));
+         if (!l) {
+            l = new QoreListNode;
+            occ->setKeyValue(name.c_str(), l, xsink);
+         }
+         l->push(v);
+         if (!count++)
+            first_bare = cbare;
+      }
+   }
+
+   bare = !count && !attrs;
+   bool req = sd_get_bool(tp, "req");
+   if (!req) {
+      // an optional type is not deserialized from an empty element without attributes
+      if (bare) {
+         rv = 0;
+         return 0;
+      }
+      // nor from a single empty element if the type has only one element
+      if (count == 1 && first_bare && el->size() == 1) {
+         rv = 0;
+         return 0;
+      }
+   }
+
+   ReferenceHolder<QoreHashNode> h(new QoreHashNode, xsink);
+   ConstHashIterator hi(el);
+   while (hi.next()) {
+      AbstractQoreNode* v;
+      if (getElementValue(reinterpret_cast<const QoreHashNode*>(hi.getValue()),
+                          reinterpret_cast<const QoreListNode*>(occ->getKeyValue(hi.getKey())), v))
+         return -1;
+      h->setKeyValue(hi.getKey(), v, xsink);
+   }
+
+   rv = h.release();
+   return 0;
+}
+
+int QoreSoapDocumentReader::getElementValue(const QoreHashNode* ep, const QoreListNode* l, AbstractQoreNode*& rv) {
+   int64 min = sd_get_int(ep, "min");
+   size_t n = l ? l->size() : 0;
+   if (!n) {
+      if (min > 0 && !sd_get_bool(ep, "nil"))
+         return -1;
+      rv = 0;
+      return 0;
+   }
+   if (n == 1) {
+      if (min > 1)
+         return -1;
+      const AbstractQoreNode* v = l->retrieve_entry(0);
+      rv = v ? v->refSelf() : 0;
+      return 0;
+   }
+   int64 max = sd_get_int(ep, "max");
+   if ((max != -1 && (int64)n > max) || (int64)n < min)
+      return -1;
+   rv = l->refSelf();
+   return 0;
+}
@@ -0,0 +1,91 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+  QoreSoapDocumentReader.h
+
+  Qore Programming Language
+
+  Copyright (C) 2017 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _QORE_QORESOAPDOCUMENTREADER_H
+#define _QORE_QORESOAPDOCUMENTREADER_H
+
+#include "QoreXmlReader.h"
+
+#include <string>
+
+// deserializes the parts of a document-style SOAP message directly from the XML reader according to a plan
+// built from the WSDL by WSDL::WSMessage::getDocumentPlan(); element values are converted to their XSD types
+// while the message is read, so no intermediate hash of the XML data is built
+//
+// the plan is a hash with the following keys:
+// - "parts": a hash of part element names to element plans with an additional "part" key giving the part name
+// - "types": a hash of named complex type plans referenced by element plans
+//
+// element plan: "min": minOccurs, "max": maxOccurs (-1 = unbounded), "nil": true if the element is nillable,
+//   "t": the type plan or the key of a named complex type plan in "types"
+// base type plan: "b": the XSD base type name, "enum": an optional hash of valid values
+// complex type plan: "req": true if the type is required, "el": a hash of element names to element plans
+//
+// the reader gives up as soon as the message contains anything not covered by the plan or anything that the
+// WSDL module would reject; in this case no value is returned, and the message must be deserialized with the
+// generic parser so that the same data or error is returned as without the plan
+class QoreSoapDocumentReader {
+public:
+   DLLLOCAL QoreSoapDocumentReader(QoreXmlReader& n_reader, const QoreHashNode* plan, const QoreEncoding* n_enc);
+
+   // returns a hash of part names to part values or 0 if the message is not covered by the plan; any exception
+   // raised while parsing is cleared in this case
+   DLLLOCAL QoreHashNode* parse(ExceptionSink* xsink);
+
+protected:
+   QoreXmlReader& reader;
+   // the part element plans
+   const QoreHashNode* parts;
+   // named complex type plans
+   const QoreHashNode* types;
+   // the encoding of string values
+   const QoreEncoding* enc;
+
+   // reads the next element, end element, text or CDATA node; returns the node type or -1 = error or end of input
+   DLLLOCAL int nextNode();
+
+   // skips the current element and its content; returns 0 = OK, -1 = error
+   DLLLOCAL int skipElement();
+
+   DLLLOCAL QoreHashNode* parseBody(ExceptionSink* xsink);
+
+   // the following functions return 0 = OK, -1 = the data is not covered by the plan
+
+   // parses the current element; "bare" is set to true if the element has no attributes and no content
+   DLLLOCAL int parseElement(const QoreHashNode* ep, AbstractQoreNode*& rv, bool& bare, ExceptionSink* xsink);
+
+   DLLLOCAL int parseSimple(const QoreHashNode* tp, bool attrs, AbstractQoreNode*& rv, bool& bare, ExceptionSink* xsink);
+
+   DLLLOCAL int parseComplex(const QoreHashNode* tp, bool attrs, AbstractQoreNode*& rv, bool& bare, ExceptionSink* xsink);
+
+   // converts the text value of the current text node to the given XSD base type
+   DLLLOCAL int convertValue(const char* type, const char* str, AbstractQoreNode*& rv, ExceptionSink* xsink);
+
+   // returns the value for an element from the list of values of all occurrences of the element
+   DLLLOCAL static int getElementValue(const QoreHashNode* ep, const QoreListNode* l, AbstractQoreNode*& rv);
+
+   // returns the type plan for the given element plan
+   DLLLOCAL const QoreHashNode* getType(const QoreHashNode* ep) const;
+};
+
+#endif
@@ -30,6 +30,66 @@
 #include "QC_XmlDoc.h"
 #include "QC_XmlNode.h"
 
+#include <string>
+#include <vector>
+#include <utility>
+
+// the maximum number of compiled expressions kept in the global XPath cache
+#define QORE_XPATH_CACHE_SIZE 128
+
+// a list of namespace prefix to URI mappings
+typedef std::vector<std::pair<std::string, std::string> > xpath_ns_vec_t;
+
+// converts a hash of namespace prefixes to URI strings to a list of UTF-8 pairs
+// returns 0 = OK, -1 = error (exception raised)
+DLLLOCAL int get_xpath_namespaces(const QoreHashNode* ns, xpath_ns_vec_t& nsv, ExceptionSink* xsink);
+
+// an XPath expression compiled once; compiled expressions are not modified when evaluated, so they can be
+// evaluated against any number of documents in any number of threads
+class QoreXPathExpression : public AbstractPrivateData {
+private:
+   xmlXPathCompExprPtr comp;
+   std::string expr;
+   // namespace mappings registered every time the expression is evaluated
+   xpath_ns_vec_t nsv;
+
+protected:
+   DLLLOCAL virtual ~QoreXPathExpression() {
+      if (comp)
+         xmlXPathFreeCompExpr(comp);
+   }
+
+public:
+   DLLLOCAL QoreXPathExpression(const char* n_expr, ExceptionSink* xsink, const QoreHashNode* ns = 0) : comp(xmlXPathCompile((const xmlChar*)n_expr)), expr(n_expr) {
+      if (!comp)
+         xsink->raiseException("XPATH-ERROR", "unable to compile xpath expression '%s'", n_expr);
+      else if (ns)
+         get_xpath_namespaces(ns, nsv, xsink);
+   }
+
+   DLLLOCAL operator bool() const {
+      return comp;
+   }
+
+   DLLLOCAL xmlXPathCompExprPtr getPtr() const {
+      return comp;
+   }
+
+   DLLLOCAL const std::string& getExpression() const {
+      return expr;
+   }
+
+   DLLLOCAL const xpath_ns_vec_t& getNamespaces() const {
+      return nsv;
+   }
+
+   // returns a referenced compiled expression from the global LRU cache, compiling and caching it if necessary
+   DLLLOCAL static QoreXPathExpression* get(const char* expr, ExceptionSink* xsink);
+
+   // releases all cached expressions
+   DLLLOCAL static void clearCache();
+};
+
 class QoreXPathObject {
 private:
    xmlXPathObjectPtr ptr;
@@ -53,6 +113,33 @@ public:
 
       return l;
    }
+   // returns the result as a scalar value: the string value of the first node for node sets, NOTHING for empty node sets
+   DLLLOCAL AbstractQoreNode *getValue() {
+      switch (ptr->type) {
+         case XPATH_NODESET:
+            if (!ptr->nodesetval || !ptr->nodesetval->nodeNr)
+               return 0;
+            return doString(xmlXPathCastNodeToString(ptr->nodesetval->nodeTab[0]));
+         case XPATH_BOOLEAN:
+            return get_bool_node(ptr->boolval);
+         case XPATH_NUMBER:
+            return new QoreFloatNode(ptr->floatval);
+         default:
+            return doString(xmlXPathCastToString(ptr));
+      }
+   }
+   // returns the string values of all nodes in a node set or a list with the string value of a scalar result
+   DLLLOCAL QoreListNode *getStrings() {
+      QoreListNode *l = new QoreListNode;
+
+      if (ptr->type != XPATH_NODESET)
+         l->push(doString(xmlXPathCastToString(ptr)));
+      else if (ptr->nodesetval && ptr->nodesetval->nodeNr)
+         for (int i = 0, e = ptr->nodesetval->nodeNr; i < e; ++i)
+            l->push(doString(xmlXPathCastNodeToString(ptr->nodesetval->nodeTab[i])));
+
+      return l;
+   }
 };
 
 class QoreXPath {
@@ -71,12 +158,34 @@ public:
 	 xmlXPathFreeContext(ptr);
    }
    DLLLOCAL QoreListNode *eval(const char *expr, ExceptionSink *xsink) {
-      QoreXPathObject xpo(xmlXPathEvalExpression((xmlChar *)expr, ptr), xsink);
-      if (!xpo) {
-         xsink->raiseException("XPATH-ERROR", "unable to evaluate xpath expression '%s'", expr);
-	 return 0;
-      }
-      return xpo.getNodeList(doc);
+      ReferenceHolder<QoreXPathExpression> xpe(QoreXPathExpression::get(expr, xsink), xsink);
+      if (!xpe)
+         return 0;
+      return eval(*xpe, xsink);
+   }
+   DLLLOCAL QoreListNode *eval(QoreXPathExpression *xpe, ExceptionSink *xsink) {
+      QoreXPathObject xpo(evalIntern(xpe, xsink), xsink);
+      return xpo ? xpo.getNodeList(doc) : 0;
+   }
+   DLLLOCAL AbstractQoreNode *evalValue(QoreXPathExpression *xpe, ExceptionSink *xsink) {
+      QoreXPathObject xpo(evalIntern(xpe, xsink), xsink);
+      return xpo ? xpo.getValue() : 0;
+   }
+   DLLLOCAL QoreListNode *evalStrings(QoreXPathExpression *xpe, ExceptionSink *xsink) {
+      QoreXPathObject xpo(evalIntern(xpe, xsink), xsink);
+      return xpo ? xpo.getStrings() : 0;
+   }
+   // registers the given namespace prefixes and variables in the context
+   // returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int bind(const QoreHashNode *ns, const QoreHashNode *vars, ExceptionSink *xsink);
+   DLLLOCAL int registerNamespaces(const xpath_ns_vec_t &nsv, ExceptionSink *xsink);
+   DLLLOCAL xmlXPathObjectPtr evalIntern(QoreXPathExpression *xpe, ExceptionSink *xsink) {
+      if (registerNamespaces(xpe->getNamespaces(), xsink))
+         return 0;
+      xmlXPathObjectPtr rv = xmlXPathCompiledEval(xpe->getPtr(), ptr);
+      if (!rv)
+         xsink->raiseException("XPATH-ERROR", "unable to evaluate xpath expression '%s'", xpe->getExpression().c_str());
+      return rv;
    }
    DLLLOCAL operator bool() const {
       return ptr;
@@ -71,6 +71,9 @@ public:
    DLLLOCAL QoreXmlDoc(const QoreString *xml) {
       init(xml->getBuffer(), xml->strlen(), xml->getEncoding()->getCode());
    }
+   // takes ownership of the document passed
+   DLLLOCAL QoreXmlDoc(xmlDocPtr p) : ptr(p) {
+   }
    DLLLOCAL QoreXmlDoc(const QoreXmlDoc &orig) {
       ptr = orig.ptr ? xmlCopyDoc(orig.ptr, 1) : 0;
    }
@@ -104,6 +107,11 @@ public:
    DLLLOCAL int validateRelaxNG(const char *rng, int size, ExceptionSink *xsink);
    DLLLOCAL int validateSchema(const char *xsd, int size, ExceptionSink *xsink);
    DLLLOCAL int validateDtd(const QoreString& dtd, ExceptionSink* xsink);
+
+   // serializes the document to the given callback with the options supported by XmlDoc::write(); the output is
+   // written in chunks as it is produced; enc is the output encoding if not given in the options
+   // returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int save(xmlOutputWriteCallback write, void* ctx, const QoreHashNode* opts, const char* enc, ExceptionSink* xsink);
 };
 
 #endif
@@ -0,0 +1,182 @@
+/* -*- indent-tabs-mode: nil -*- */
+/*
+  QoreXmlReadAhead.cpp
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "QoreXmlReadAhead.h"
+
+#include <string.h>
+
+int QoreXmlReadAheadOptions::set(const QoreHashNode* opts, const char* err, ExceptionSink* xsink) {
+   if (!opts)
+      return 0;
+
+   bool found;
+   bool enabled = opts->getKeyAsBool("read_ahead", found);
+   // the buffer options only enable read-ahead implicitly if the read_ahead option is not given
+   bool implicit = !found;
+
+   int64 v = opts->getKeyAsBigInt("chunk_size", found);
+   if (found) {
+      if (v <= 0 || v > 0x7fffffff) {
+         xsink->raiseException(err, "invalid 'chunk_size' option value " QLLD "; expecting a positive integer", v);
+         return -1;
+      }
+      chunk_size = (int)v;
+      if (implicit)
+         enabled = true;
+   }
+
+   v = opts->getKeyAsBigInt("max_buffer", found);
+   if (found) {
+      if (v <= 0 || v > 0x7fffffff) {
+         xsink->raiseException(err, "invalid 'max_buffer' option value " QLLD "; expecting a positive integer", v);
+         return -1;
+      }
+      max_buffer = (int)v;
+      if (implicit)
+         enabled = true;
+   }
+
+   if (max_buffer < chunk_size)
+      max_buffer = chunk_size;
+
+   return enabled ? 1 : 0;
+}
+
+// builtin stream classes supported with read-ahead
+static const char* read_ahead_streams[] = { "BinaryInputStream", "StringInputStream", "FileInputStream", 0 };
+
+int QoreXmlReadAheadBuffer::checkStream(const QoreObject* obj, const char* err, ExceptionSink* xsink) {
+   const QoreClass* qc = obj->getClass();
+   if (qc->isSystem()) {
+      for (const char** p = read_ahead_streams; *p; ++p) {
+         if (!strcmp(qc->getName(), *p))
+            return 0;
+      }
+   }
+   xsink->raiseException(err, "read-ahead is not supported for streams of class '%s'; only the builtin BinaryInputStream, StringInputStream and FileInputStream classes are supported", qc->getName());
+   return -1;
+}
+
+QoreXmlReadAheadBuffer::QoreXmlReadAheadBuffer(InputStream* n_is, const QoreXmlReadAheadOptions& opts)
+   : is(n_is), ring(opts.max_buffer), head(0), size(0), chunk_size(opts.chunk_size), eof(false), stopped(false) {
+   is->ref();
+}
+
+QoreXmlReadAheadBuffer::~QoreXmlReadAheadBuffer() {
+   // exceptions not delivered to the reader are discarded
+   err.clear();
+   ExceptionSink xsink;
+   is->deref(&xsink);
+   xsink.clear();
+}
+
+int QoreXmlReadAheadBuffer::start(ExceptionSink* xsink) {
+   // one reference for the background thread
+   ref();
+   if (q_start_thread(xsink, threadFunc, this) < 0) {
+      deref();
+      return -1;
+   }
+   return 0;
+}
+
+void QoreXmlReadAheadBuffer::threadFunc(ExceptionSink* xsink, void* arg) {
+   QoreXmlReadAheadBuffer* rab = static_cast<QoreXmlReadAheadBuffer*>(arg);
+   rab->run();
+   rab->deref();
+}
+
+void QoreXmlReadAheadBuffer::run() {
+   std::vector<char> chunk(chunk_size);
+
+   while (true) {
+      size_t len;
+      {
+         AutoLocker al(m);
+         // apply backpressure: wait until there is room for at least one byte
+         while (!stopped && size == ring.size())
+            space_cond.wait(m);
+         if (stopped)
+            return;
+         len = ring.size() - size;
+         if (len > (size_t)chunk_size)
+            len = chunk_size;
+      }
+
+      // read from the stream without holding the lock so the parser can consume data in parallel
+      ExceptionSink xsink;
+      int64 rc = is->read(&chunk[0], len, &xsink);
+
+      AutoLocker al(m);
+      if (xsink || rc <= 0) {
+         if (xsink)
+            err.assimilate(xsink);
+         eof = true;
+         data_cond.signal();
+         return;
+      }
+
+      // copy the data into the ring buffer, wrapping around at the end
+      size_t tail = (head + size) % ring.size();
+      size_t n = ring.size() - tail;
+      if (n > (size_t)rc)
+         n = rc;
+      memcpy(&ring[tail], &chunk[0], n);
+      if (n < (size_t)rc)
+         memcpy(&ring[0], &chunk[n], rc - n);
+      size += rc;
+      data_cond.signal();
+   }
+}
+
+int QoreXmlReadAheadBuffer::read(char* buf, int len, ExceptionSink* xsink) {
+   AutoLocker al(m);
+   while (!size && !eof)
+      data_cond.wait(m);
+
+   if (!size) {
+      if (err) {
+         xsink->assimilate(err);
+         return -1;
+      }
+      return 0;
+   }
+
+   size_t rc = size < (size_t)len ? size : len;
+   size_t n = ring.size() - head;
+   if (n > rc)
+      n = rc;
+   memcpy(buf, &ring[head], n);
+   if (n < rc)
+      memcpy(buf + n, &ring[0], rc - n);
+   head = (head + rc) % ring.size();
+   size -= rc;
+   space_cond.signal();
+   return rc;
+}
+
+void QoreXmlReadAheadBuffer::stop() {
+   AutoLocker al(m);
+   stopped = true;
+   space_cond.signal();
+}
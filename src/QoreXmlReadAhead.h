@@ -0,0 +1,105 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+  QoreXmlReadAhead.h
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _QORE_QOREXMLREADAHEAD_H
+#define _QORE_QOREXMLREADAHEAD_H
+
+#include "qore-xml-module.h"
+
+#include "qore/InputStream.h"
+#include "qore/QoreThreadLock.h"
+#include "qore/QoreCondition.h"
+
+#include <vector>
+
+// default read-ahead chunk size
+#define QORE_XML_READ_AHEAD_CHUNK_SIZE (64 * 1024)
+// default maximum number of bytes buffered ahead of the parser
+#define QORE_XML_READ_AHEAD_MAX_BUFFER (1024 * 1024)
+
+// read-ahead options for stream-based parsing
+class QoreXmlReadAheadOptions {
+public:
+   int chunk_size;
+   int max_buffer;
+
+   DLLLOCAL QoreXmlReadAheadOptions() : chunk_size(QORE_XML_READ_AHEAD_CHUNK_SIZE), max_buffer(QORE_XML_READ_AHEAD_MAX_BUFFER) {
+   }
+
+   // parses the "read_ahead", "chunk_size" and "max_buffer" keys of the given option hash
+   // returns 1 = read-ahead enabled, 0 = not enabled, -1 = error (exception raised)
+   DLLLOCAL int set(const QoreHashNode* opts, const char* err, ExceptionSink* xsink);
+};
+
+// a bounded ring buffer filled from an InputStream by a background thread; the thread blocks when the buffer is
+// full and the parser blocks when it is empty; the object is referenced by both the reader and the thread
+class QoreXmlReadAheadBuffer : public AbstractPrivateData {
+public:
+   DLLLOCAL QoreXmlReadAheadBuffer(InputStream* n_is, const QoreXmlReadAheadOptions& opts);
+
+   // starts the background thread; returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int start(ExceptionSink* xsink);
+
+   // copies buffered data into the given buffer, blocking until data is available
+   // returns the number of bytes copied, 0 = end of stream, -1 = error (exception raised)
+   DLLLOCAL int read(char* buf, int len, ExceptionSink* xsink);
+
+   // tells the background thread to stop; must be called by the owner before releasing its reference
+   DLLLOCAL void stop();
+
+   // checks if the given stream object can be read by the background thread; returns 0 = OK, -1 = error (exception raised)
+   /* only builtin stream classes whose reads return in a bounded time are supported: Qore code must not run in the
+      background thread, and a read blocked on a stalled stream cannot be interrupted when the reader is destroyed
+   */
+   DLLLOCAL static int checkStream(const QoreObject* obj, const char* err, ExceptionSink* xsink);
+
+protected:
+   DLLLOCAL virtual ~QoreXmlReadAheadBuffer();
+
+private:
+   InputStream* is;
+   std::vector<char> ring;
+   // the offset of the first unread byte in the ring buffer
+   size_t head;
+   // the number of unread bytes in the ring buffer
+   size_t size;
+   int chunk_size;
+   // set when the stream is exhausted or an error occurred
+   bool eof;
+   // set when the reader no longer needs the data
+   bool stopped;
+   // any exception raised by the stream in the background thread
+   ExceptionSink err;
+
+   QoreThreadLock m;
+   // signaled when data is added or the stream ends
+   QoreCondition data_cond;
+   // signaled when space is freed or the buffer is stopped
+   QoreCondition space_cond;
+
+   DLLLOCAL void run();
+
+   DLLLOCAL static void threadFunc(ExceptionSink* xsink, void* arg);
+};
+
+#endif
@@ -24,6 +24,8 @@
 #include "QoreXmlReader.h"
 #include "QoreXmlRpcReader.h"
 
+#include <string>
+
 static bool keys_are_equal(const char* k1, const char* k2, bool &get_value) {
    while (true) {
       if (!(*k1)) {
@@ -59,97 +61,48 @@ QoreHashNode* QoreXmlReader::parseXmlData(const QoreEncoding* data_ccsid, int pf
    return reinterpret_cast<QoreHashNode*>(rv);
 }
 
-AbstractQoreNode* QoreXmlReader::getXmlData(ExceptionSink* xsink, const QoreEncoding* data_ccsid, int pflags, int min_depth) {
-   Qore::Xml::intern::xml_stack xstack;
+AbstractQoreNode* QoreXmlReader::getElementData(const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink) {
+   assert(nodeType() == XML_READER_TYPE_ELEMENT);
+
+   ReferenceHolder<AbstractQoreNode> rv(getXmlData(xsink, data_ccsid, pflags, depth(), true), xsink);
+   if (!rv) {
+      if (!*xsink)
+         xsink->raiseExceptionArg("PARSE-XML-EXCEPTION", xml ? new QoreStringNode(*xml) : 0, "parse error parsing XML element");
+      return 0;
+   }
+   assert(rv->getType() == NT_HASH);
+
+   QoreHashNode* h = reinterpret_cast<QoreHashNode*>(*rv);
+   return h->takeKeyValue(h->getFirstKey());
+}
+
+AbstractQoreNode* QoreXmlReader::getXmlData(ExceptionSink* xsink, const QoreEncoding* data_ccsid, int pflags, int min_depth, bool single) {
+   Qore::Xml::intern::xml_data_builder builder(pflags);
 
    QORE_TRACE("getXMLData()");
    int rc = 1;
+   int start_depth = single ? QoreXmlReader::depth() : -1;
 
    while (rc == 1) {
       int nt = nodeTypeSkipWhitespace();
       // get node name
-      const char* name = constName();
+      const char* name = (pflags & XPF_STRIP_NS_PREFIXES) ? localName() : constName();
       if (!name)
 	 name = "--";
 
       if (nt == -1) // ERROR
 	 break;
 
+      // stop at the end of the element in single element mode
+      if (single && nt == XML_READER_TYPE_END_ELEMENT && QoreXmlReader::depth() == start_depth) {
+         rc = 0;
+         break;
+      }
+
       if (nt == XML_READER_TYPE_ELEMENT) {
 	 int depth = QoreXmlReader::depth();
-	 xstack.checkDepth(depth);
-
-	 AbstractQoreNode* n = xstack.getNode();
-	 // if there is no node pointer, then make a hash
-	 if (!n) {
-	    QoreHashNode* h = new QoreHashNode;
-	    xstack.setNode(h);
-	    xstack.push(h->getKeyValuePtr(name), depth);
-	 }
-	 else { // node ptr already exists
-	    QoreHashNode* h = n->getType() == NT_HASH ? reinterpret_cast<QoreHashNode*>(n) : 0;
-	    if (!h) {
-	       h = new QoreHashNode;
-	       xstack.setNode(h);
-	       h->setKeyValue("^value^", n, 0);
-	       xstack.incValueCount();
-	       xstack.push(h->getKeyValuePtr(name), depth);
-	    }
-	    else {
-	       // see if key already exists
-	       AbstractQoreNode* v;
-	       bool exists;
-	       v = h->getKeyValueExistence(name, exists);
-
-	       if (!exists)
-		  xstack.push(h->getKeyValuePtr(name), depth);
-	       else {
-		  if (!(pflags & XPF_PRESERVE_ORDER)) {
-		     QoreListNode* vl = get_node_type(v) == NT_LIST ? reinterpret_cast<QoreListNode*>(v) : 0;
-		     // if it's not a list, then make into a list with current value as first entry
-		     if (!vl) {
-			AbstractQoreNode** vp = h->getKeyValuePtr(name);
-			vl = new QoreListNode;
-			vl->push(v);
-			(*vp) = vl;
-		     }
-		     xstack.push(vl->get_entry_ptr(vl->size()), depth);
-		  }
-		  else {
-		     // see if last key was the same, if so make a list if it's not
-		     const char* lk = h->getLastKey();
-		     bool get_value = false;
-		     if (keys_are_equal(name, lk, get_value)) {
-			// get actual key value if there was a suffix
-			if (get_value)
-			   v = h->getKeyValue(lk);
-
-			QoreListNode* vl = get_node_type(v) == NT_LIST ? reinterpret_cast<QoreListNode*>(v) : 0;
-			// if it's not a list, then make into a list with current value as first entry
-			if (!vl) {
-			   AbstractQoreNode** vp = h->getKeyValuePtr(lk);
-			   vl = new QoreListNode;
-			   vl->push(v);
-			   (*vp) = vl;
-			}
-			xstack.push(vl->get_entry_ptr(vl->size()), depth);
-		     }
-		     else {
-			QoreString ns;
-			int c = 1;
-			while (true) {
-			   ns.sprintf("%s^%d", name, c);
-			   if (!h->existsKey(ns.getBuffer()))
-			      break;
-			   c++;
-			   ns.clear();
-			}
-			xstack.push(h->getKeyValuePtr(ns.getBuffer()), depth);
-		     }
-		  }
-	       }
-	    }
-	 }
+	 builder.startElement(name, depth);
+
 	 // add attributes to structure if possible
 	 if (hasAttributes()) {
 	    ReferenceHolder<QoreHashNode> h(new QoreHashNode, xsink);
@@ -163,116 +116,34 @@ AbstractQoreNode* QoreXmlReader::getXmlData(ExceptionSink* xsink, const QoreEnco
 	    if (*xsink)
 	       return 0;
 
-	    // make new new a hash and assign "^attributes^" key
-	    QoreHashNode* nv = new QoreHashNode;
-	    nv->setKeyValue("^attributes^", h.release(), xsink);
-	    xstack.setNode(nv);
+	    builder.setAttributes(h.release(), xsink);
 	 }
 	 //printd(5, "%s: type: %d, hasValue: %d, empty: %d, depth: %d\n", name, nt, xmlTextReaderHasValue(reader), xmlTextReaderIsEmptyElement(reader), depth);
-      }
-      else if (nt == XML_READER_TYPE_TEXT) {
-	 int depth = QoreXmlReader::depth();
-	 xstack.checkDepth(depth);
 
-	 const char* str = constValue();
-	 if (str) {
-            QoreStringNodeHolder val(getValue(data_ccsid, xsink));
-	    if (!val)
-	       return 0;
-
-	    AbstractQoreNode* n = xstack.getNode();
-	    if (n) {
-	       QoreHashNode* h = n->getType() == NT_HASH ? reinterpret_cast<QoreHashNode*>(n) : 0;
-	       if (h) {
-		  if (!xstack.getValueCount())
-		     h->setKeyValue("^value^", val.release(), xsink);
-		  else {
-		     QoreString kstr;
-		     kstr.sprintf("^value%d^", xstack.getValueCount());
-		     h->setKeyValue(kstr.getBuffer(), val.release(), xsink);
-		  }
-	       }
-	       else { // convert value to hash and save value node
-		  h = new QoreHashNode;
-		  xstack.setNode(h);
-		  h->setKeyValue("^value^", n, 0);
-		  xstack.incValueCount();
-
-		  QoreString kstr;
-		  kstr.sprintf("^value%d^", 1);
-		  h->setKeyValue(kstr.getBuffer(), val.release(), xsink);
-	       }
-	       xstack.incValueCount();
-	    }
-	    else
-	       xstack.setNode(val.release());
-	 }
+         // an empty element has no end node
+         if (single && depth == start_depth) {
+            if (hasAttributes())
+               moveToElement(xsink);
+            if (isEmptyElement()) {
+               rc = 0;
+               break;
+            }
+         }
       }
-      else if (nt == XML_READER_TYPE_CDATA) {
-	 int depth = QoreXmlReader::depth();
-	 xstack.checkDepth(depth);
-
+      else if (nt == XML_READER_TYPE_TEXT || nt == XML_READER_TYPE_CDATA || (nt == XML_READER_TYPE_COMMENT && (pflags & XPF_ADD_COMMENTS))) {
 	 const char* str = constValue();
 	 if (str) {
 	    QoreStringNode* val = getValue(data_ccsid, xsink);
 	    if (!val)
 	       return 0;
 
-	    AbstractQoreNode* n = xstack.getNode();
-	    if (n && n->getType() == NT_HASH) {
-	       QoreHashNode* h = reinterpret_cast<QoreHashNode*>(n);
-	       if (!xstack.getCDataCount())
-		  h->setKeyValue("^cdata^", val, xsink);
-	       else {
-		  QoreString kstr;
-		  kstr.sprintf("^cdata%d^", xstack.getCDataCount());
-		  h->setKeyValue(kstr.getBuffer(), val, xsink);
-	       }
-	    }
-	    else { // convert value to hash and save value node
-	       QoreHashNode* h = new QoreHashNode;
-	       xstack.setNode(h);
-	       if (n) {
-		  h->setKeyValue("^value^", n, 0);
-		  xstack.incValueCount();
-	       }
-
-	       h->setKeyValue("^cdata^", val, xsink);
-	    }
-	    xstack.incCDataCount();
-	 }
-      } else if (nt == XML_READER_TYPE_COMMENT && (pflags & XPF_ADD_COMMENTS)) {
-	 int depth = QoreXmlReader::depth();
-	 xstack.checkDepth(depth);
-
-	 const char* str = constValue();
-	 if (str) {
-	    QoreStringNode* val = getValue(data_ccsid, xsink);
-	    if (!val)
-	       return 0;
-
-	    AbstractQoreNode* n = xstack.getNode();
-	    if (n && n->getType() == NT_HASH) {
-	       QoreHashNode* h = reinterpret_cast<QoreHashNode*>(n);
-	       if (!xstack.getCommentCount())
-		  h->setKeyValue("^comment^", val, xsink);
-	       else {
-		  QoreString kstr;
-		  kstr.sprintf("^comment%d^", xstack.getCommentCount());
-		  h->setKeyValue(kstr.getBuffer(), val, xsink);
-	       }
-	    }
-	    else { // convert value to hash and save value node
-	       QoreHashNode* h = new QoreHashNode;
-	       xstack.setNode(h);
-	       if (n) {
-		  h->setKeyValue("^value^", n, 0);
-		  xstack.incValueCount();
-	       }
-
-	       h->setKeyValue("^comment^", val, xsink);
-	    }
-	    xstack.incCommentCount();
+	    int depth = QoreXmlReader::depth();
+	    if (nt == XML_READER_TYPE_TEXT)
+	       builder.addText(val, depth, xsink);
+	    else if (nt == XML_READER_TYPE_CDATA)
+	       builder.addCData(val, depth, xsink);
+	    else
+	       builder.addComment(val, depth, xsink);
 	 }
       }
       rc = read();
@@ -282,5 +153,296 @@ AbstractQoreNode* QoreXmlReader::getXmlData(ExceptionSink* xsink, const QoreEnco
          break;
       }
    }
-   return rc ? 0 : xstack.getVal();
+   return rc ? 0 : builder.getVal();
+}
+
+namespace Qore {
+namespace Xml {
+namespace intern {
+void xml_data_builder::startElement(const char* name, int depth) {
+   xstack.checkDepth(depth);
+
+   AbstractQoreNode* n = xstack.getNode();
+   // if there is no node pointer, then make a hash
+   if (!n) {
+      QoreHashNode* h = new QoreHashNode;
+      xstack.setNode(h);
+      xstack.push(h->getKeyValuePtr(name), depth);
+      return;
+   }
+
+   // node ptr already exists
+   QoreHashNode* h = n->getType() == NT_HASH ? reinterpret_cast<QoreHashNode*>(n) : 0;
+   if (!h) {
+      h = new QoreHashNode;
+      xstack.setNode(h);
+      h->setKeyValue("^value^", n, 0);
+      xstack.incValueCount();
+      xstack.push(h->getKeyValuePtr(name), depth);
+      return;
+   }
+
+   // see if key already exists
+   AbstractQoreNode* v;
+   bool exists;
+   v = h->getKeyValueExistence(name, exists);
+
+   if (!exists) {
+      xstack.push(h->getKeyValuePtr(name), depth);
+      return;
+   }
+
+   if (!(pflags & XPF_PRESERVE_ORDER)) {
+      QoreListNode* vl = get_node_type(v) == NT_LIST ? reinterpret_cast<QoreListNode*>(v) : 0;
+      // if it's not a list, then make into a list with current value as first entry
+      if (!vl) {
+	 AbstractQoreNode** vp = h->getKeyValuePtr(name);
+	 vl = new QoreListNode;
+	 vl->push(v);
+	 (*vp) = vl;
+      }
+      xstack.push(vl->get_entry_ptr(vl->size()), depth);
+      return;
+   }
+
+   // see if last key was the same, if so make a list if it's not
+   const char* lk = h->getLastKey();
+   bool get_value = false;
+   if (keys_are_equal(name, lk, get_value)) {
+      // get actual key value if there was a suffix
+      if (get_value)
+	 v = h->getKeyValue(lk);
+
+      QoreListNode* vl = get_node_type(v) == NT_LIST ? reinterpret_cast<QoreListNode*>(v) : 0;
+      // if it's not a list, then make into a list with current value as first entry
+      if (!vl) {
+	 AbstractQoreNode** vp = h->getKeyValuePtr(lk);
+	 vl = new QoreListNode;
+	 vl->push(v);
+	 (*vp) = vl;
+      }
+      xstack.push(vl->get_entry_ptr(vl->size()), depth);
+      return;
+   }
+
+   QoreString ns;
+   int c = 1;
+   while (true) {
+      ns.sprintf("%s^%d", name, c);
+      if (!h->existsKey(ns.getBuffer()))
+	 break;
+      c++;
+      ns.clear();
+   }
+   xstack.push(h->getKeyValuePtr(ns.getBuffer()), depth);
+}
+
+void xml_data_builder::addText(QoreStringNode* v, int depth, ExceptionSink* xsink) {
+   QoreStringNodeHolder val(v);
+   xstack.checkDepth(depth);
+
+   AbstractQoreNode* n = xstack.getNode();
+   if (!n) {
+      xstack.setNode(val.release());
+      return;
+   }
+
+   QoreHashNode* h = n->getType() == NT_HASH ? reinterpret_cast<QoreHashNode*>(n) : 0;
+   if (h) {
+      if (!xstack.getValueCount())
+	 h->setKeyValue("^value^", val.release(), xsink);
+      else {
+	 QoreString kstr;
+	 kstr.sprintf("^value%d^", xstack.getValueCount());
+	 h->setKeyValue(kstr.getBuffer(), val.release(), xsink);
+      }
+   }
+   else { // convert value to hash and save value node
+      h = new QoreHashNode;
+      xstack.setNode(h);
+      h->setKeyValue("^value^", n, 0);
+      xstack.incValueCount();
+
+      QoreString kstr;
+      kstr.sprintf("^value%d^", 1);
+      h->setKeyValue(kstr.getBuffer(), val.release(), xsink);
+   }
+   xstack.incValueCount();
+}
+
+void xml_data_builder::addCData(QoreStringNode* val, int depth, ExceptionSink* xsink) {
+   xstack.checkDepth(depth);
+
+   AbstractQoreNode* n = xstack.getNode();
+   if (n && n->getType() == NT_HASH) {
+      QoreHashNode* h = reinterpret_cast<QoreHashNode*>(n);
+      if (!xstack.getCDataCount())
+	 h->setKeyValue("^cdata^", val, xsink);
+      else {
+	 QoreString kstr;
+	 kstr.sprintf("^cdata%d^", xstack.getCDataCount());
+	 h->setKeyValue(kstr.getBuffer(), val, xsink);
+      }
+   }
+   else { // convert value to hash and save value node
+      QoreHashNode* h = new QoreHashNode;
+      xstack.setNode(h);
+      if (n) {
+	 h->setKeyValue("^value^", n, 0);
+	 xstack.incValueCount();
+      }
+
+      h->setKeyValue("^cdata^", val, xsink);
+   }
+   xstack.incCDataCount();
+}
+
+void xml_data_builder::addComment(QoreStringNode* val, int depth, ExceptionSink* xsink) {
+   xstack.checkDepth(depth);
+
+   AbstractQoreNode* n = xstack.getNode();
+   if (n && n->getType() == NT_HASH) {
+      QoreHashNode* h = reinterpret_cast<QoreHashNode*>(n);
+      if (!xstack.getCommentCount())
+	 h->setKeyValue("^comment^", val, xsink);
+      else {
+	 QoreString kstr;
+	 kstr.sprintf("^comment%d^", xstack.getCommentCount());
+	 h->setKeyValue(kstr.getBuffer(), val, xsink);
+      }
+   }
+   else { // convert value to hash and save value node
+      QoreHashNode* h = new QoreHashNode;
+      xstack.setNode(h);
+      if (n) {
+	 h->setKeyValue("^value^", n, 0);
+	 xstack.incValueCount();
+      }
+
+      h->setKeyValue("^comment^", val, xsink);
+   }
+   xstack.incCommentCount();
+}
+}
+}
+}
+
+// returns the qualified name for the given name and namespace
+static const char* xml_qualified_name(const xmlChar* name, xmlNsPtr ns, std::string& buf) {
+   if (!ns || !ns->prefix)
+      return (const char*)name;
+   buf = (const char*)ns->prefix;
+   buf += ':';
+   buf += (const char*)name;
+   return buf.c_str();
+}
+
+static QoreStringNode* xml_get_value(const char* str, const QoreEncoding* id, ExceptionSink* xsink) {
+   if (id == QCS_UTF8)
+      return new QoreStringNode(str, QCS_UTF8);
+
+   return QoreStringNode::createAndConvertEncoding(str, QCS_UTF8, id, xsink);
+}
+
+// adds the node and its subtree to the builder in the same order and at the same depth as a reader would report them
+// returns 0 = OK, -1 = error (exception raised)
+static int xml_add_node(Qore::Xml::intern::xml_data_builder& builder, xmlNodePtr n, int depth, const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink) {
+   switch (n->type) {
+      case XML_ELEMENT_NODE: {
+         std::string buf;
+         builder.startElement((pflags & XPF_STRIP_NS_PREFIXES) ? (const char*)n->name : xml_qualified_name(n->name, n->ns, buf), depth);
+
+         // namespace declarations are returned before attributes, as with xmlTextReaderMoveToNextAttribute()
+         if (n->nsDef || n->properties) {
+            ReferenceHolder<QoreHashNode> h(new QoreHashNode, xsink);
+            for (xmlNsPtr ns = n->nsDef; ns; ns = ns->next) {
+               QoreStringNode* value = xml_get_value(ns->href ? (const char*)ns->href : "", data_ccsid, xsink);
+               if (!value)
+                  return -1;
+               if (ns->prefix) {
+                  buf = "xmlns:";
+                  buf += (const char*)ns->prefix;
+                  h->setKeyValue(buf.c_str(), value, xsink);
+               }
+               else
+                  h->setKeyValue("xmlns", value, xsink);
+            }
+            for (xmlAttrPtr a = n->properties; a; a = a->next) {
+               xmlChar* v = xmlNodeListGetString(n->doc, a->children, 1);
+               QoreStringNode* value = xml_get_value(v ? (const char*)v : "", data_ccsid, xsink);
+               if (v)
+                  xmlFree(v);
+               if (!value)
+                  return -1;
+               h->setKeyValue(xml_qualified_name(a->name, a->ns, buf), value, xsink);
+            }
+            if (*xsink)
+               return -1;
+            builder.setAttributes(h.release(), xsink);
+         }
+
+         for (xmlNodePtr c = n->children; c; c = c->next) {
+            if (xml_add_node(builder, c, depth + 1, data_ccsid, pflags, xsink))
+               return -1;
+         }
+         return 0;
+      }
+
+      case XML_TEXT_NODE:
+         // blank nodes are reported as whitespace by the reader and are ignored
+         if (!n->content || xmlIsBlankNode(n))
+            return 0;
+         break;
+
+      case XML_CDATA_SECTION_NODE:
+         if (!n->content)
+            return 0;
+         break;
+
+      case XML_COMMENT_NODE:
+         if (!(pflags & XPF_ADD_COMMENTS) || !n->content)
+            return 0;
+         break;
+
+      default:
+         return 0;
+   }
+
+   QoreStringNode* val = xml_get_value((const char*)n->content, data_ccsid, xsink);
+   if (!val)
+      return -1;
+   if (n->type == XML_TEXT_NODE)
+      builder.addText(val, depth, xsink);
+   else if (n->type == XML_CDATA_SECTION_NODE)
+      builder.addCData(val, depth, xsink);
+   else
+      builder.addComment(val, depth, xsink);
+   return *xsink ? -1 : 0;
+}
+
+// returns the value built if it is a hash, otherwise raises an exception
+static QoreHashNode* xml_get_hash(Qore::Xml::intern::xml_data_builder& builder, ExceptionSink* xsink) {
+   ReferenceHolder<AbstractQoreNode> rv(builder.getVal(), xsink);
+   if (get_node_type(*rv) != NT_HASH) {
+      xsink->raiseException("PARSE-XML-EXCEPTION", "the XML data does not contain any elements");
+      return 0;
+   }
+   return reinterpret_cast<QoreHashNode*>(rv.release());
+}
+
+QoreHashNode* xml_doc_to_hash(xmlDocPtr doc, const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink) {
+   Qore::Xml::intern::xml_data_builder builder(pflags);
+   for (xmlNodePtr n = doc->children; n; n = n->next) {
+      if (xml_add_node(builder, n, 0, data_ccsid, pflags, xsink))
+         return 0;
+   }
+   return xml_get_hash(builder, xsink);
+}
+
+QoreHashNode* xml_node_to_hash(xmlNodePtr node, const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink) {
+   assert(node->type == XML_ELEMENT_NODE);
+   Qore::Xml::intern::xml_data_builder builder(pflags);
+   if (xml_add_node(builder, node, 0, data_ccsid, pflags, xsink))
+      return 0;
+   return xml_get_hash(builder, xsink);
 }
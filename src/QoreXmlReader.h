@@ -30,6 +30,8 @@
 
 #include "qore-xml-module.h"
 #include "QoreXmlDoc.h"
+#include "QoreXmlSplitter.h"
+#include "QoreXmlReadAhead.h"
 
 #include <errno.h>
 
@@ -42,6 +44,10 @@ protected:
    ExceptionSink* xs;
    int fd;
    ReferenceHolder<InputStream> inputStream;
+   // provides the data when parsing a record range of a file
+   QoreXmlRangeInput* range_input;
+   // buffers stream data read by a background thread, if enabled
+   QoreXmlReadAheadBuffer* read_ahead;
 
    static void qore_xml_error_func(QoreXmlReader* xr, const char* msg, xmlParserSeverities severity, xmlTextReaderLocatorPtr locator) {
       if (severity == XML_PARSER_SEVERITY_VALIDITY_WARNING
@@ -55,12 +61,23 @@ protected:
 	 return;
       QoreStringNode* desc = new QoreStringNode(msg);
       desc->chomp();
+      // report the position in the input when iterating records
+      int64 rec = xr->getErrorRecord();
+      if (rec >= 0) {
+         desc->sprintf(" (record " QLLD, rec);
+         int line = locator ? xmlTextReaderLocatorLineNumber(locator) : -1;
+         if (line > 0)
+            desc->sprintf(", line %d", line);
+         desc->concat(')');
+      }
       xr->xs->raiseException("PARSE-XML-EXCEPTION", desc);
    }
 
    static int streamReadCallback(void *context, char *buffer, int len) {
       QoreXmlReader *xmlReader = static_cast<QoreXmlReader *>(context);
-      int64 i = xmlReader->inputStream->read(buffer, len, xmlReader->xs);
+      int64 i = xmlReader->read_ahead
+         ? xmlReader->read_ahead->read(buffer, len, xmlReader->xs)
+         : xmlReader->inputStream->read(buffer, len, xmlReader->xs);
       if (*xmlReader->xs) {
          return -1;
       }
@@ -71,12 +88,18 @@ protected:
       return 0;
    }
 
+   // returns the 1-based index of the record being read for error reporting or -1 if records are not being iterated
+   DLLLOCAL virtual int64 getErrorRecord() {
+      return -1;
+   }
+
    DLLLOCAL void setExceptionSink(ExceptionSink* xsink) {
       assert((!xsink && xs) || (xsink && !xs));
       xs = xsink;
    }
 
-   DLLLOCAL AbstractQoreNode* getXmlData(ExceptionSink* xsink, const QoreEncoding* data_ccsid, int pflags = XPF_NONE, int min_depth = -1);
+   // if "single" is true, then the reader must be positioned on an element, and parsing stops at the end of that element
+   DLLLOCAL AbstractQoreNode* getXmlData(ExceptionSink* xsink, const QoreEncoding* data_ccsid, int pflags = XPF_NONE, int min_depth = -1, bool single = false);
 
    DLLLOCAL void init(const char* enc, int options, ExceptionSink* xsink) {
       xml = 0;
@@ -114,7 +137,7 @@ protected:
       //xmlTextReaderSetErrorHandler(reader, (xmlTextReaderErrorFunc)qore_xml_error_func, xsink);
    }
 
-   DLLLOCAL void init(ExceptionSink* xsink, const char* fn, const char* encoding, int options) {
+   DLLLOCAL void init(ExceptionSink* xsink, const char* fn, const char* encoding, int options, const QoreXmlRecordRange* range = 0) {
       xml = 0;
       fd = open(fn, O_RDONLY);
       if (fd < 0) {
@@ -122,9 +145,15 @@ protected:
          xsink->raiseErrnoException("XML-READER-ERROR", errno, "could not open '%s' for reading", fn);
          return;
       }
-      reader = xmlReaderForFd(fd, 0, encoding, options);
+      if (range) {
+         range_input = new QoreXmlRangeInput(fd, *range);
+         reader = xmlReaderForIO(QoreXmlRangeInput::readCallback, streamCloseCallback, range_input, 0, encoding, options);
+      }
+      else
+         reader = xmlReaderForFd(fd, 0, encoding, options);
       if (!reader) {
          close(fd);
+         fd = -1;
 	 xsink->raiseException("XML-READER-ERROR", "could not create XML reader");
 	 return;
       }
@@ -138,27 +167,36 @@ protected:
       return rc;
    }
 
-   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, InputStream *is, const char* enc, int options) : xs(0), fd(-1), inputStream(is, xsink) {
+   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, InputStream *is, const char* enc, int options, const QoreXmlReadAheadOptions* rao = 0) : xs(0), fd(-1), inputStream(is, xsink), range_input(0), read_ahead(0) {
+      if (rao) {
+         read_ahead = new QoreXmlReadAheadBuffer(is, *rao);
+         if (read_ahead->start(xsink)) {
+            read_ahead->deref();
+            read_ahead = 0;
+            reader = 0;
+            return;
+         }
+      }
       init(enc, options, xsink);
    }
 
-   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, const QoreString* n_xml, int options) : xs(0), fd(-1), inputStream(xsink) {
+   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, const QoreString* n_xml, int options) : xs(0), fd(-1), inputStream(xsink), range_input(0), read_ahead(0) {
       init(n_xml, options, xsink);
    }
 
-   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, xmlDocPtr doc) : xs(0), fd(-1), inputStream(xsink) {
+   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, xmlDocPtr doc) : xs(0), fd(-1), inputStream(xsink), range_input(0), read_ahead(0) {
       init(doc, xsink);
    }
 
-   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, const QoreString* n_xml, int options, xmlDocPtr doc, const char* fn, const char* enc) : xs(0), fd(-1), inputStream(xsink) {
+   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, const QoreString* n_xml, int options, xmlDocPtr doc, const char* fn, const char* enc, const QoreXmlRecordRange* range = 0) : xs(0), fd(-1), inputStream(xsink), range_input(0), read_ahead(0) {
       if (fn)
-         init(xsink, fn, enc, options);
+         init(xsink, fn, enc, options, range);
       else
          init(xsink, n_xml, options, doc);
    }
 
-   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, const char* fn, const char* encoding, int options) : xs(0), fd(-1), inputStream(xsink) {
-      init(xsink, fn, encoding, options);
+   DLLLOCAL QoreXmlReader(ExceptionSink* xsink, const char* fn, const char* encoding, int options, const QoreXmlRecordRange* range = 0) : xs(0), fd(-1), inputStream(xsink), range_input(0), read_ahead(0) {
+      init(xsink, fn, encoding, options, range);
    }
 
    DLLLOCAL void reset(ExceptionSink* xsink, const QoreString* n_xml, int options, xmlDocPtr doc) {
@@ -169,14 +207,18 @@ protected:
       init(xsink, n_xml, options, doc);
    }
 
-   DLLLOCAL void reset(ExceptionSink* xsink, const char* fn, const char* enc, int options) {
+   DLLLOCAL void reset(ExceptionSink* xsink, const char* fn, const char* enc, int options, const QoreXmlRecordRange* range = 0) {
       if (reader) {
 	 xmlFreeTextReader(reader);
          reader = 0;
       }
       if (fd >= 0)
          close(fd);
-      init(xsink, fn, enc, options);
+      if (range_input) {
+         delete range_input;
+         range_input = 0;
+      }
+      init(xsink, fn, enc, options, range);
    }
 
    DLLLOCAL void init(ExceptionSink* xsink, const QoreString* n_xml, int options, xmlDocPtr doc) {
@@ -193,19 +235,24 @@ protected:
    }
 
 public:
-   DLLLOCAL QoreXmlReader(const QoreString* n_xml, int options, ExceptionSink* xsink) : xs(xsink), fd(-1), inputStream(xsink) {
+   DLLLOCAL QoreXmlReader(const QoreString* n_xml, int options, ExceptionSink* xsink) : xs(xsink), fd(-1), inputStream(xsink), range_input(0), read_ahead(0) {
       init(n_xml, options, xsink);
    }
 
-   DLLLOCAL QoreXmlReader(xmlDocPtr doc, ExceptionSink* xsink) : xs(xsink), fd(-1), inputStream(xsink) {
+   DLLLOCAL QoreXmlReader(xmlDocPtr doc, ExceptionSink* xsink) : xs(xsink), fd(-1), inputStream(xsink), range_input(0), read_ahead(0) {
       init(doc, xsink);
    }
 
-   DLLLOCAL ~QoreXmlReader() {
+   DLLLOCAL virtual ~QoreXmlReader() {
       if (reader)
 	 xmlFreeTextReader(reader);
       if (fd >= 0)
          close(fd);
+      delete range_input;
+      if (read_ahead) {
+         read_ahead->stop();
+         read_ahead->deref();
+      }
    }
 
    DLLLOCAL operator bool() const {
@@ -487,6 +534,17 @@ public:
 #endif
 
    DLLLOCAL QoreHashNode* parseXmlData(const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink);
+
+   // returns the value of the element the reader is positioned on and leaves the reader on the element's end node
+   // (or on the element itself if it is empty); returns 0 for empty elements and errors, check xsink for errors
+   DLLLOCAL AbstractQoreNode* getElementData(const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink);
 };
 
+// converts a parsed document directly to a hash with the same output as QoreXmlReader::parseXmlData() without
+// replaying the tree through a reader; returns 0 if there is an error (exception raised)
+DLLLOCAL QoreHashNode* xml_doc_to_hash(xmlDocPtr doc, const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink);
+
+// converts an element and its subtree to a hash keyed by the element's name in the same way
+DLLLOCAL QoreHashNode* xml_node_to_hash(xmlNodePtr node, const QoreEncoding* data_ccsid, int pflags, ExceptionSink* xsink);
+
 #endif
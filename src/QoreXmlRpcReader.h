@@ -146,6 +146,37 @@ namespace intern { // make classes local
 	 tail->commentcount++;
       }
    };
+
+   // builds the Qore data structure for XML data from a sequence of nodes in document order; used both by
+   // QoreXmlReader::getXmlData() and by the direct conversion of xmlNodePtr trees so that both give the same output
+   class xml_data_builder {
+   private:
+      xml_stack xstack;
+      int pflags;
+
+   public:
+      DLLLOCAL xml_data_builder(int n_pflags) : pflags(n_pflags) {
+      }
+
+      // adds an element with the given qualified name at the given depth
+      DLLLOCAL void startElement(const char* name, int depth);
+
+      // sets the attribute hash of the element last added
+      DLLLOCAL void setAttributes(QoreHashNode* h, ExceptionSink* xsink) {
+	 QoreHashNode* nv = new QoreHashNode;
+	 nv->setKeyValue("^attributes^", h, xsink);
+	 xstack.setNode(nv);
+      }
+
+      // the following functions take ownership of the value
+      DLLLOCAL void addText(QoreStringNode* val, int depth, ExceptionSink* xsink);
+      DLLLOCAL void addCData(QoreStringNode* val, int depth, ExceptionSink* xsink);
+      DLLLOCAL void addComment(QoreStringNode* val, int depth, ExceptionSink* xsink);
+
+      DLLLOCAL AbstractQoreNode* getVal() {
+	 return xstack.getVal();
+      }
+   };
 }
 }
 }
@@ -0,0 +1,446 @@
+/* -*- indent-tabs-mode: nil -*- */
+/*
+  QoreXmlSplitter.cpp
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "QoreXmlSplitter.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !((defined _WIN32 || defined __WIN32__) && ! defined __CYGWIN__)
+#define QORE_XML_SPLITTER_MMAP 1
+#include <sys/mman.h>
+#endif
+
+int QoreXmlRecordRange::set(const QoreHashNode* h, ExceptionSink* xsink) {
+   bool found;
+   start = h->getKeyAsBigInt("start", found);
+   if (!found || start < 0) {
+      xsink->raiseException("XML-RANGE-ERROR", "the record range hash is missing a valid 'start' key");
+      return -1;
+   }
+   end = h->getKeyAsBigInt("end", found);
+   if (!found || end < start) {
+      xsink->raiseException("XML-RANGE-ERROR", "the record range hash is missing a valid 'end' key");
+      return -1;
+   }
+   count = h->getKeyAsBigInt("count", found);
+
+   const AbstractQoreNode* n = h->getKeyValue("header");
+   if (get_node_type(n) != NT_STRING) {
+      xsink->raiseException("XML-RANGE-ERROR", "the record range hash is missing the 'header' string key");
+      return -1;
+   }
+   header = reinterpret_cast<const QoreStringNode*>(n)->getBuffer();
+
+   n = h->getKeyValue("footer");
+   if (get_node_type(n) != NT_STRING) {
+      xsink->raiseException("XML-RANGE-ERROR", "the record range hash is missing the 'footer' string key");
+      return -1;
+   }
+   footer = reinterpret_cast<const QoreStringNode*>(n)->getBuffer();
+   return 0;
+}
+
+QoreHashNode* QoreXmlRecordRange::getHash() const {
+   QoreHashNode* h = new QoreHashNode;
+   h->setKeyValue("start", new QoreBigIntNode(start), 0);
+   h->setKeyValue("end", new QoreBigIntNode(end), 0);
+   h->setKeyValue("count", new QoreBigIntNode(count), 0);
+   h->setKeyValue("header", new QoreStringNode(header.c_str(), QCS_UTF8), 0);
+   h->setKeyValue("footer", new QoreStringNode(footer.c_str(), QCS_UTF8), 0);
+   return h;
+}
+
+bool QoreXmlSplitter::match(const char* name, size_t len) const {
+   if (len == element_name.size() && !memcmp(name, element_name.data(), len))
+      return true;
+   // compare the local name
+   const char* c = (const char*)memchr(name, ':', len);
+   if (!c)
+      return false;
+   ++c;
+   len -= (c - name);
+   return len == element_name.size() && !memcmp(c, element_name.data(), len);
+}
+
+const char* QoreXmlSplitter::skipTo(const char* p, const char* e, const char* term, size_t tlen) {
+   while (p < e) {
+      p = (const char*)memchr(p, *term, e - p);
+      if (!p || (size_t)(e - p) < tlen)
+         return 0;
+      if (!memcmp(p, term, tlen))
+         return p + tlen;
+      ++p;
+   }
+   return 0;
+}
+
+const char* QoreXmlSplitter::tagEnd(const char* p, const char* e) {
+   char quote = 0;
+   for (; p < e; ++p) {
+      if (quote) {
+         if (*p == quote)
+            quote = 0;
+      }
+      else if (*p == '"' || *p == '\'')
+         quote = *p;
+      else if (*p == '>')
+         return p;
+   }
+   return 0;
+}
+
+const char* QoreXmlSplitter::doctypeEnd(const char* p, const char* e) {
+   char quote = 0;
+   int subset = 0;
+   for (; p < e; ++p) {
+      if (quote) {
+         if (*p == quote)
+            quote = 0;
+         continue;
+      }
+      switch (*p) {
+         case '"':
+         case '\'':
+            quote = *p;
+            break;
+         case '[':
+            ++subset;
+            break;
+         case ']':
+            if (subset)
+               --subset;
+            break;
+         case '>':
+            if (!subset)
+               return p;
+            break;
+      }
+   }
+   return 0;
+}
+
+void QoreXmlSplitter::setRoot(const char* p, const char* te, size_t nlen) {
+   header += '<';
+   header.append(p + 1, nlen);
+
+   // copy namespace declarations and xml:* attributes to the synthetic root element
+   const char* a = p + 1 + nlen;
+   while (a < te) {
+      while (a < te && isspace(*a))
+         ++a;
+      const char* an = a;
+      while (a < te && *a != '=' && *a != '/' && !isspace(*a))
+         ++a;
+      size_t anlen = a - an;
+      if (!anlen) {
+         ++a;
+         continue;
+      }
+      while (a < te && isspace(*a))
+         ++a;
+      if (a == te || *a != '=')
+         continue;
+      ++a;
+      while (a < te && isspace(*a))
+         ++a;
+      if (a == te || (*a != '"' && *a != '\''))
+         break;
+      const char* ve = (const char*)memchr(a + 1, *a, te - a - 1);
+      if (!ve)
+         break;
+      if ((anlen >= 5 && !strncmp(an, "xmlns", 5) && (anlen == 5 || an[5] == ':'))
+          || (anlen > 4 && !strncmp(an, "xml:", 4))) {
+         header += ' ';
+         header.append(an, ve + 1 - an);
+      }
+      a = ve + 1;
+   }
+   header += '>';
+
+   footer = "</";
+   footer.append(p + 1, nlen);
+   footer += '>';
+}
+
+int QoreXmlSplitter::split(const char* buf, int64 len, int parts, xml_range_vec_t& rv, ExceptionSink* xsink) {
+   if (parts < 1)
+      parts = 1;
+
+   const char* p = buf;
+   const char* e = buf + len;
+
+   // only ASCII-compatible encodings can be scanned for markup bytes
+   if (len >= 2 && (((unsigned char)buf[0] == 0xfe && (unsigned char)buf[1] == 0xff)
+                    || ((unsigned char)buf[0] == 0xff && (unsigned char)buf[1] == 0xfe))) {
+      xsink->raiseException("XML-SPLIT-ERROR", "UTF-16 encoded XML data cannot be split; only ASCII-compatible encodings are supported");
+      return -1;
+   }
+   // skip any UTF-8 BOM
+   if (len >= 3 && !memcmp(buf, "\xef\xbb\xbf", 3))
+      p += 3;
+
+   header.clear();
+   footer.clear();
+
+   bool root = false;
+   bool in_record = false;
+   int depth = 0;
+   const char* rec_start = 0;
+
+   QoreXmlRecordRange cur;
+   int64 next_split = parts > 1 ? len / parts : len;
+
+   while (p < e) {
+      p = (const char*)memchr(p, '<', e - p);
+      if (!p)
+         break;
+      const char* q = p + 1;
+      const char* te;
+
+      if (q < e && *q == '?') {
+         te = skipTo(q, e, "?>", 2);
+         if (!te) {
+            xsink->raiseException("XML-SPLIT-ERROR", "unterminated processing instruction at offset " QLLD, (int64)(p - buf));
+            return -1;
+         }
+         // keep the XML declaration and any other prolog PIs in the header
+         if (!root)
+            header.append(p, te - p);
+         p = te;
+         continue;
+      }
+
+      if (q < e && *q == '!') {
+         if ((e - q) >= 3 && !strncmp(q, "!--", 3)) {
+            te = skipTo(q + 3, e, "-->", 3);
+            if (!te) {
+               xsink->raiseException("XML-SPLIT-ERROR", "unterminated comment at offset " QLLD, (int64)(p - buf));
+               return -1;
+            }
+         }
+         else if ((e - q) >= 8 && !strncmp(q, "![CDATA[", 8)) {
+            te = skipTo(q + 8, e, "]]>", 3);
+            if (!te) {
+               xsink->raiseException("XML-SPLIT-ERROR", "unterminated CDATA section at offset " QLLD, (int64)(p - buf));
+               return -1;
+            }
+         }
+         else {
+            te = doctypeEnd(q, e);
+            if (!te) {
+               xsink->raiseException("XML-SPLIT-ERROR", "unterminated declaration at offset " QLLD, (int64)(p - buf));
+               return -1;
+            }
+            ++te;
+            // the DOCTYPE may declare entities used in the records
+            if (!root)
+               header.append(p, te - p);
+         }
+         p = te;
+         continue;
+      }
+
+      if (q < e && *q == '/') {
+         te = (const char*)memchr(q, '>', e - q);
+         if (!te || !depth) {
+            xsink->raiseException("XML-SPLIT-ERROR", "invalid end tag at offset " QLLD, (int64)(p - buf));
+            return -1;
+         }
+         p = te + 1;
+         if (--depth == 1 && in_record) {
+            in_record = false;
+            addRecord(rv, cur, next_split, rec_start - buf, p - buf, len, parts);
+         }
+         else if (!depth)
+            break;
+         continue;
+      }
+
+      // start tag
+      te = tagEnd(q, e);
+      if (!te) {
+         xsink->raiseException("XML-SPLIT-ERROR", "unterminated start tag at offset " QLLD, (int64)(p - buf));
+         return -1;
+      }
+      const char* ne = q;
+      while (ne < te && *ne != '/' && !isspace(*ne))
+         ++ne;
+      bool empty = te[-1] == '/';
+
+      if (!depth) {
+         root = true;
+         setRoot(p, te, ne - q);
+         if (empty)
+            break;
+         depth = 1;
+      }
+      else if (depth == 1 && match(q, ne - q)) {
+         rec_start = p;
+         if (empty)
+            addRecord(rv, cur, next_split, p - buf, te + 1 - buf, len, parts);
+         else {
+            in_record = true;
+            depth = 2;
+         }
+      }
+      else if (!empty)
+         ++depth;
+      p = te + 1;
+   }
+
+   if (!root) {
+      xsink->raiseException("XML-SPLIT-ERROR", "no root element found in the XML data");
+      return -1;
+   }
+   if (in_record) {
+      xsink->raiseException("XML-SPLIT-ERROR", "unterminated '%s' element at offset " QLLD, element_name.c_str(), (int64)(rec_start - buf));
+      return -1;
+   }
+
+   if (cur.isSet())
+      rv.push_back(cur);
+
+   for (xml_range_vec_t::iterator i = rv.begin(), ie = rv.end(); i != ie; ++i) {
+      i->header = header;
+      i->footer = footer;
+   }
+   return 0;
+}
+
+void QoreXmlSplitter::addRecord(xml_range_vec_t& rv, QoreXmlRecordRange& cur, int64& next_split, int64 start, int64 end, int64 len, int parts) {
+   if (!cur.isSet())
+      cur.start = start;
+   cur.end = end;
+   ++cur.count;
+
+   if (end < next_split)
+      return;
+
+   rv.push_back(cur);
+   cur = QoreXmlRecordRange();
+
+   // the last range takes all remaining records
+   if ((int)rv.size() >= parts - 1) {
+      next_split = len + 1;
+      return;
+   }
+   int k = rv.size() + 1;
+   while ((next_split = (len / parts) * k) <= end && k < parts)
+      ++k;
+   if (k >= parts)
+      next_split = len + 1;
+}
+
+int QoreXmlSplitter::splitFile(const char* fn, int parts, xml_range_vec_t& rv, ExceptionSink* xsink) {
+   int fd = open(fn, O_RDONLY);
+   if (fd < 0) {
+      xsink->raiseErrnoException("XML-SPLIT-ERROR", errno, "could not open '%s' for reading", fn);
+      return -1;
+   }
+   ON_BLOCK_EXIT(close, fd);
+
+   struct stat sbuf;
+   if (fstat(fd, &sbuf)) {
+      xsink->raiseErrnoException("XML-SPLIT-ERROR", errno, "could not stat '%s'", fn);
+      return -1;
+   }
+   if (!sbuf.st_size)
+      return split("", 0, parts, rv, xsink);
+
+#ifdef QORE_XML_SPLITTER_MMAP
+   void* m = mmap(0, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (m == MAP_FAILED) {
+      xsink->raiseErrnoException("XML-SPLIT-ERROR", errno, "could not map '%s' for reading", fn);
+      return -1;
+   }
+#ifdef MADV_SEQUENTIAL
+   madvise(m, sbuf.st_size, MADV_SEQUENTIAL);
+#endif
+   int rc = split((const char*)m, sbuf.st_size, parts, rv, xsink);
+   munmap(m, sbuf.st_size);
+   return rc;
+#else
+   std::string buf;
+   buf.resize(sbuf.st_size);
+   int64 pos = 0;
+   while (pos < sbuf.st_size) {
+      int rc = ::read(fd, &buf[pos], sbuf.st_size - pos);
+      if (rc <= 0) {
+         xsink->raiseErrnoException("XML-SPLIT-ERROR", errno, "error reading '%s'", fn);
+         return -1;
+      }
+      pos += rc;
+   }
+   return split(buf.data(), buf.size(), parts, rv, xsink);
+#endif
+}
+
+int QoreXmlRangeInput::read(char* buf, int len) {
+   if (hpos < header.size()) {
+      size_t n = header.size() - hpos;
+      if (n > (size_t)len)
+         n = len;
+      memcpy(buf, header.data() + hpos, n);
+      hpos += n;
+      return n;
+   }
+
+   if (pos < end) {
+      if (!positioned) {
+         if (lseek(fd, pos, SEEK_SET) != pos)
+            return -1;
+         positioned = true;
+      }
+      int64 n = end - pos;
+      if (n > len)
+         n = len;
+      int rc;
+      while (true) {
+         rc = ::read(fd, buf, n);
+         if (rc >= 0 || errno != EINTR)
+            break;
+      }
+      // a short file means that the range does not belong to this file
+      if (rc <= 0)
+         return -1;
+      pos += rc;
+      return rc;
+   }
+
+   if (fpos < footer.size()) {
+      size_t n = footer.size() - fpos;
+      if (n > (size_t)len)
+         n = len;
+      memcpy(buf, footer.data() + fpos, n);
+      fpos += n;
+      return n;
+   }
+
+   return 0;
+}
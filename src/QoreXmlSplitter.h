@@ -0,0 +1,121 @@
+/* -*- mode: c++; indent-tabs-mode: nil -*- */
+/*
+  QoreXmlSplitter.h
+
+  Qore Programming Language
+
+  Copyright (C) 2016 Qore Technologies, s.r.o.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _QORE_QOREXMLSPLITTER_H
+#define _QORE_QOREXMLSPLITTER_H
+
+#include "qore-xml-module.h"
+
+#include <string>
+#include <vector>
+
+// a byte range of an XML file containing only complete top-level records; the header holds the XML
+// declaration, any DOCTYPE and a copy of the root element's start tag with its namespace declarations
+// so that the range can be parsed as a standalone document
+class QoreXmlRecordRange {
+public:
+   int64 start;
+   int64 end;
+   int64 count;
+   std::string header;
+   std::string footer;
+
+   DLLLOCAL QoreXmlRecordRange() : start(-1), end(-1), count(0) {
+   }
+
+   DLLLOCAL bool isSet() const {
+      return start >= 0;
+   }
+
+   // returns 0 = OK, -1 = error (exception raised)
+   DLLLOCAL int set(const QoreHashNode* h, ExceptionSink* xsink);
+
+   DLLLOCAL QoreHashNode* getHash() const;
+};
+
+typedef std::vector<QoreXmlRecordRange> xml_range_vec_t;
+
+// scans XML data for the boundaries of the elements with the given name that are direct children of the
+// root element, skipping comments, CDATA sections, processing instructions and any DOCTYPE declaration
+class QoreXmlSplitter {
+public:
+   DLLLOCAL QoreXmlSplitter(const char* n_element_name) : element_name(n_element_name) {
+   }
+
+   // splits the given buffer into at most "parts" ranges of complete records with roughly equal sizes
+   DLLLOCAL int split(const char* buf, int64 len, int parts, xml_range_vec_t& rv, ExceptionSink* xsink);
+
+   // maps the file and splits it; see split()
+   DLLLOCAL int splitFile(const char* fn, int parts, xml_range_vec_t& rv, ExceptionSink* xsink);
+
+private:
+   std::string element_name;
+   std::string header;
+   std::string footer;
+
+   // returns true if the qualified name given matches the element name by qualified or local name
+   DLLLOCAL bool match(const char* name, size_t len) const;
+
+   // returns a pointer to the first character after the terminating sequence or 0 if not found
+   DLLLOCAL static const char* skipTo(const char* p, const char* e, const char* term, size_t tlen);
+
+   // returns a pointer to the closing '>' of a tag, respecting quoted attribute values, or 0 if not found
+   DLLLOCAL static const char* tagEnd(const char* p, const char* e);
+
+   // returns a pointer to the closing '>' of a DOCTYPE declaration including any internal subset, or 0
+   DLLLOCAL static const char* doctypeEnd(const char* p, const char* e);
+
+   // creates the header and footer from the root element start tag
+   DLLLOCAL void setRoot(const char* p, const char* te, size_t nlen);
+
+   // adds a record to the current range and closes the range when the next split offset has been reached
+   DLLLOCAL static void addRecord(xml_range_vec_t& rv, QoreXmlRecordRange& cur, int64& next_split, int64 start, int64 end, int64 len, int parts);
+};
+
+// provides the data for a record range as a standalone XML document
+class QoreXmlRangeInput {
+public:
+   DLLLOCAL QoreXmlRangeInput(int n_fd, const QoreXmlRecordRange& range) : fd(n_fd), pos(range.start), end(range.end),
+                                                                          header(range.header), footer(range.footer),
+                                                                          hpos(0), fpos(0), positioned(false) {
+   }
+
+   // returns the number of bytes written to the buffer, 0 = end of data, -1 = I/O error
+   DLLLOCAL int read(char* buf, int len);
+
+   DLLLOCAL static int readCallback(void* context, char* buf, int len) {
+      return static_cast<QoreXmlRangeInput*>(context)->read(buf, len);
+   }
+
+private:
+   int fd;
+   int64 pos;
+   int64 end;
+   std::string header;
+   std::string footer;
+   size_t hpos;
+   size_t fpos;
+   bool positioned;
+};
+
+#endif
@@ -34,6 +34,8 @@
 DLLLOCAL void init_xml_constants(QoreNamespace& ns);
 
 DLLLOCAL QoreStringNode* make_xml(ExceptionSink* xsink, const QoreEncoding* enc, const QoreHashNode& h, int flags = XGF_NONE);
+// creates a document tree directly from the hash with the same content as parsing the output of make_xml()
+DLLLOCAL xmlDocPtr make_xml_doc(ExceptionSink* xsink, const QoreHashNode& h);
 DLLLOCAL QoreStringNode* make_xmlrpc_call(ExceptionSink* xsink, const QoreEncoding* ccs, int offset, const QoreValueList* args, int flags = 0);
 DLLLOCAL QoreStringNode* make_xmlrpc_call_args(ExceptionSink* xsink, const QoreEncoding* ccs, int offset, const QoreValueList* args, int flags = 0);
 // ccsid is the output encoding for strings
@@ -47,6 +47,8 @@
 #define XPF_PRESERVE_ORDER       (1 << 20)
 // parse comments and put as elements with key ^comment^ in hash
 #define XPF_ADD_COMMENTS         (1 << 21)
+// use element local names without namespace prefixes as hash keys
+#define XPF_STRIP_NS_PREFIXES    (1 << 22)
 
 #define XPF_DECODE_MASK (XPF_DECODE_NUMERIC_REFS | XPF_DECODE_XHTML_REFS)
 
@@ -26,6 +26,8 @@
 #include "QC_XmlNode.h"
 #include "QC_XmlReader.h"
 #include "QC_SaxIterator.h"
+#include "QC_XPath.h"
+#include "QC_XmlNodeIterator.h"
 
 #include "ql_xml.h"
 
@@ -83,6 +85,8 @@ QoreStringNode *xml_module_init() {
    xmlSetGenericErrorFunc((void*)&err, (xmlGenericErrorFunc)qoreXmlIgnoreErrorFunc);
 
    XNS.addSystemClass(initXmlNodeClass(XNS));
+   XNS.addSystemClass(initXmlNodeIteratorClass(XNS));
+   XNS.addSystemClass(initXPathClass(XNS));
    XNS.addSystemClass(initXmlDocClass(XNS));
    XNS.addSystemClass(initXmlReaderClass(XNS));
    XNS.addSystemClass(initSaxIteratorClass(XNS));
@@ -110,6 +114,9 @@ void xml_module_ns_init(QoreNamespace *rns, QoreNamespace *qns) {
 }
 
 void xml_module_delete() {
+   // free cached XPath expressions before cleaning up the library
+   QoreXPathExpression::clearCache();
+
    // cleanup libxml2 library
    xmlCleanupParser();
 }